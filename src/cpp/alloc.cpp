@@ -0,0 +1,75 @@
+#include "alloc.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
+
+namespace alloc {
+  std::atomic<PageMode> _page_mode = PageMode::Default;
+
+  size_t _mapped_size(size_t bytes) {
+    return (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+  }
+
+  void set_page_mode(PageMode mode) {
+    _page_mode = mode;
+  }
+
+  PageMode page_mode() {
+    return _page_mode;
+  }
+
+  void *allocate(size_t bytes) {
+    if (bytes < HUGE_PAGE_SIZE) {
+      return ::operator new(bytes, std::align_val_t{ALLOC_ALIGNMENT});
+    }
+
+    // NOTE: Large arrays are always rounded up to whole huge pages so
+    //       `deallocate` can unmap them without knowing the mode they were
+    //       allocated with.
+    size_t size = _mapped_size(bytes);
+    void *ptr = MAP_FAILED;
+    PageMode mode = page_mode();
+
+    if (mode == PageMode::Explicit) {
+      ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (ptr == MAP_FAILED) {
+      // NOTE: Regular mappings are only page aligned. Map a huge page more
+      //       and trim both ends so every huge page of the array can be
+      //       backed by one.
+      void *raw = mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (raw == MAP_FAILED) {
+        throw std::bad_alloc();
+      }
+      uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+      uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+      if (aligned > start) {
+        munmap(raw, aligned - start);
+      }
+      if (start + HUGE_PAGE_SIZE > aligned) {
+        munmap(reinterpret_cast<void*>(aligned + size), start + HUGE_PAGE_SIZE - aligned);
+      }
+      ptr = reinterpret_cast<void*>(aligned);
+      if (mode != PageMode::Default) {
+        madvise(ptr, size, MADV_HUGEPAGE);
+      }
+    }
+
+    return ptr;
+  }
+
+  void deallocate(void *ptr, size_t bytes) {
+    if (!ptr) {
+      return;
+    }
+
+    if (bytes < HUGE_PAGE_SIZE) {
+      ::operator delete(ptr, std::align_val_t{ALLOC_ALIGNMENT});
+    } else {
+      munmap(ptr, _mapped_size(bytes));
+    }
+  }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+constexpr size_t ALLOC_ALIGNMENT = 64;             // bytes, one cache line
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024; // bytes
+
+enum class PageMode : uint32_t {
+  Default,     // Regular pages.
+  Transparent, // Ask for transparent huge pages (madvise).
+  Explicit,    // Reserve explicit huge pages (MAP_HUGETLB), else fall back.
+};
+
+namespace alloc {
+  /**
+   * Select how large particle and grid arrays are backed. Must be called
+   * before any such array is allocated.
+   */
+  void set_page_mode(PageMode mode);
+  PageMode page_mode();
+
+  /**
+   * Cache line aligned storage. Arrays of at least one huge page are mapped
+   * directly, aligned to HUGE_PAGE_SIZE, so their pages are only placed on a
+   * NUMA node when first written and can all be backed by huge pages.
+   */
+  void *allocate(size_t bytes);
+  void deallocate(void *ptr, size_t bytes);
+}
+
+/**
+ * Allocator for the particle and grid arrays. New elements are
+ * default-initialized (i.e. not written) so the first touch happens in the
+ * parallel loops that fill them, not in `resize`.
+ */
+template<typename T>
+struct ParticleAllocator {
+  using value_type = T;
+
+  ParticleAllocator() = default;
+  template<typename U>
+  ParticleAllocator(const ParticleAllocator<U>&) { }
+
+  T *allocate(size_t n) {
+    return static_cast<T*>(alloc::allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T *ptr, size_t n) {
+    alloc::deallocate(ptr, n * sizeof(T));
+  }
+
+  template<typename U>
+  void construct(U *ptr) {
+    ::new(static_cast<void*>(ptr)) U;
+  }
+
+  template<typename U, typename... Args>
+  void construct(U *ptr, Args&&... args) {
+    ::new(static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+  }
+
+  template<typename U>
+  bool operator==(const ParticleAllocator<U>&) const { return true; }
+};
+
+template<typename T>
+using ParticleArray = std::vector<T, ParticleAllocator<T>>;
@@ -0,0 +1,81 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+
+FrameArena::FrameArena()
+: block{nullptr},
+  capacity{0},
+  used{0},
+  overflow_bytes{0},
+  peak{0} { }
+
+FrameArena::~FrameArena() {
+  for (std::byte *extra : overflow) {
+    ::operator delete(extra, std::align_val_t{ARENA_ALIGNMENT});
+  }
+  if (block) {
+    ::operator delete(block, std::align_val_t{ARENA_ALIGNMENT});
+  }
+}
+
+std::byte *FrameArena::alloc_bytes(size_t size) {
+  size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+  std::byte *result;
+  if (used + size <= capacity) {
+    result = block + used;
+    used += size;
+  } else {
+    result = static_cast<std::byte*>(::operator new(size, std::align_val_t{ARENA_ALIGNMENT}));
+    overflow.push_back(result);
+    overflow_bytes += size;
+  }
+
+  peak = std::max(peak, used + overflow_bytes);
+  return result;
+}
+
+size_t FrameArena::mark() const {
+  return used;
+}
+
+void FrameArena::rewind(size_t mark) {
+  used = std::min(used, mark);
+  if (used == 0 && !overflow.empty()) {
+    reset();
+  }
+}
+
+void FrameArena::reset() {
+  used = 0;
+  if (overflow.empty()) {
+    return;
+  }
+
+  for (std::byte *extra : overflow) {
+    ::operator delete(extra, std::align_val_t{ARENA_ALIGNMENT});
+  }
+  overflow.clear();
+  overflow_bytes = 0;
+
+  if (peak > capacity) {
+    if (block) {
+      ::operator delete(block, std::align_val_t{ARENA_ALIGNMENT});
+    }
+    // Leave some headroom so small growth in the particle count does not
+    // immediately overflow again.
+    capacity = peak + (peak / 4);
+    block = static_cast<std::byte*>(::operator new(capacity, std::align_val_t{ARENA_ALIGNMENT}));
+  }
+}
+
+size_t FrameArena::bytes_in_use() const {
+  return used + overflow_bytes;
+}
+
+FrameArena &frame_arena() {
+  static thread_local FrameArena arena;
+  return arena;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+constexpr size_t ARENA_ALIGNMENT = 64; // bytes, one cache line
+
+/**
+ * Bump allocator for per-step scratch buffers.
+ *
+ * Allocations are released in bulk by rewinding to a mark (see ArenaScope).
+ * Requests that do not fit are served from overflow blocks; once the arena
+ * is empty again it grows to the peak size seen, so after the first few
+ * steps no scratch allocation touches the heap.
+ */
+class FrameArena {
+  std::byte *block;
+  size_t capacity;
+  size_t used;
+  std::vector<std::byte*> overflow;
+  size_t overflow_bytes;
+  size_t peak;
+
+  std::byte *alloc_bytes(size_t size);
+
+  public:
+    FrameArena();
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    /**
+     * Uninitialized, cache line aligned storage for `count` values.
+     */
+    template<typename T>
+    requires std::is_trivially_destructible_v<T>
+    std::span<T> alloc(size_t count) {
+      return { reinterpret_cast<T*>(alloc_bytes(sizeof(T) * count)), count };
+    }
+
+    size_t mark() const;
+    void rewind(size_t mark);
+
+    /**
+     * Release everything and fold overflow blocks into one block sized for
+     * the peak usage.
+     */
+    void reset();
+
+    size_t bytes_in_use() const;
+};
+
+/**
+ * Rewinds an arena to where it was when the scope was entered.
+ */
+class ArenaScope {
+  FrameArena &arena;
+  size_t start;
+
+  public:
+    explicit ArenaScope(FrameArena &arena) : arena{arena}, start{arena.mark()} { }
+    ~ArenaScope() { arena.rewind(start); }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+};
+
+/**
+ * The calling thread's scratch arena.
+ */
+FrameArena &frame_arena();
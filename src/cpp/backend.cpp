@@ -0,0 +1,29 @@
+#include "backend.h"
+
+#include <optional>
+#include <string_view>
+
+namespace exec {
+  std::optional<Backend> parse_backend(std::string_view name) {
+    if (name == "serial") {
+      return Backend::Serial;
+    } else if (name == "openmp") {
+      return Backend::OpenMP;
+    } else if (name == "stdpar") {
+      return Backend::StdPar;
+    } else if (name == "pool") {
+      return Backend::ThreadPool;
+    }
+    return std::nullopt;
+  }
+
+  std::string_view backend_name(Backend backend) {
+    switch (backend) {
+      case Backend::Serial: return "serial";
+      case Backend::OpenMP: return "openmp";
+      case Backend::StdPar: return "stdpar";
+      case Backend::ThreadPool: return "pool";
+    }
+    return "unknown";
+  }
+}
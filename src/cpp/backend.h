@@ -0,0 +1,33 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+
+namespace exec {
+  /**
+   * How the solver loops are run. All backends produce identical results:
+   * every loop writes each element from exactly one iteration, and no
+   * iteration depends on the order the others run in.
+   */
+  enum class Backend {
+    Serial,
+    OpenMP,     // `omp parallel for`; serial in builds without OpenMP.
+    StdPar,     // C++17 parallel algorithms.
+    ThreadPool, // The work-stealing task pool.
+  };
+
+#if defined(SPH_DEFAULT_BACKEND)
+  constexpr Backend DEFAULT_BACKEND = Backend::SPH_DEFAULT_BACKEND;
+#elif defined(_OPENMP)
+  constexpr Backend DEFAULT_BACKEND = Backend::ThreadPool;
+#else
+  constexpr Backend DEFAULT_BACKEND = Backend::Serial;
+#endif
+
+  /**
+   * Parse a backend name as given on the command line: serial, openmp,
+   * stdpar or pool.
+   */
+  std::optional<Backend> parse_backend(std::string_view name);
+  std::string_view backend_name(Backend backend);
+}
@@ -0,0 +1,204 @@
+#include "checkpoint.h"
+
+#include "particles.h"
+#include "sim_opts.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <libcommon/vec.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace checkpoint {
+  constexpr char MAGIC[8] = { 'S', 'P', 'H', 'C', 'K', 'P', 'T', '\0' };
+  constexpr uint64_t ARRAY_ALIGNMENT = 64;
+
+  // NOTE: Stored in native byte order. Every array starts on a 64 byte
+  //       boundary so a mapping can be copied from without realignment.
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t particle_count;
+    float particle_radius;
+    float gas_constant;
+    float rest_density;
+    float support;
+    float viscosity_constant;
+    uint32_t cell_ratio;
+    uint32_t prune_stencil;
+    float time_step;
+    uint64_t pos_offset;
+    uint64_t vel_offset;
+    uint64_t density_offset;
+    uint64_t pressure_offset;
+    uint64_t file_size;
+  };
+
+  uint64_t _align(uint64_t offset) {
+    return (offset + ARRAY_ALIGNMENT - 1) & ~(ARRAY_ALIGNMENT - 1);
+  }
+
+  const char *error_message(CheckpointError error) {
+    switch (error) {
+      case CheckpointError::Open:          return "Failed to open checkpoint";
+      case CheckpointError::Map:           return "Failed to map checkpoint";
+      case CheckpointError::Write:         return "Failed to write checkpoint";
+      case CheckpointError::BadMagic:      return "Not a checkpoint file";
+      case CheckpointError::BadVersion:    return "Unsupported checkpoint version";
+      case CheckpointError::Truncated:     return "Checkpoint is truncated";
+      case CheckpointError::BadParameters: return "Checkpoint holds invalid simulation parameters";
+    }
+    return "Unknown checkpoint error";
+  }
+
+  std::expected<void, CheckpointError> save(const std::filesystem::path &path, const Particles &ps, const SimOpts &opts) {
+    uint64_t count = ps.size();
+    Header header{};
+
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = CHECKPOINT_VERSION;
+    header.particle_count = static_cast<uint32_t>(count);
+    header.particle_radius = opts.particle_radius;
+    header.gas_constant = opts.gas_constant;
+    header.rest_density = opts.rest_density;
+    header.support = opts.support;
+    header.viscosity_constant = opts.viscosity_constant;
+    header.cell_ratio = opts.cell_ratio;
+    header.prune_stencil = opts.prune_stencil ? 1 : 0;
+    header.time_step = opts.time_step;
+    header.pos_offset = _align(sizeof(Header));
+    header.vel_offset = _align(header.pos_offset + count * sizeof(Vec3));
+    header.density_offset = _align(header.vel_offset + count * sizeof(Vec3));
+    header.pressure_offset = _align(header.density_offset + count * sizeof(float));
+    header.file_size = header.pressure_offset + count * sizeof(float);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return std::unexpected(CheckpointError::Open);
+    }
+
+    auto write_at = [&file](uint64_t offset, const void *data, uint64_t size) {
+      static constexpr char zeros[ARRAY_ALIGNMENT] = {};
+      uint64_t position = static_cast<uint64_t>(file.tellp());
+      file.write(zeros, offset - position);
+      file.write(static_cast<const char*>(data), size);
+    };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    write_at(header.pos_offset, ps.pos.data(), count * sizeof(Vec3));
+    write_at(header.vel_offset, ps.vel.data(), count * sizeof(Vec3));
+    write_at(header.density_offset, ps.density.data(), count * sizeof(float));
+    write_at(header.pressure_offset, ps.pressure.data(), count * sizeof(float));
+
+    if (!file.flush()) {
+      return std::unexpected(CheckpointError::Write);
+    }
+
+    return {};
+  }
+
+  // Whether `size` bytes at `offset` lie within the file, without the sum
+  // wrapping around on a corrupt offset.
+  bool _fits(uint64_t offset, uint64_t size, uint64_t file_size) {
+    return offset <= file_size && size <= file_size - offset;
+  }
+
+  // Whether `value` is a usable length or duration. NaN fails both tests.
+  bool _positive(float value) {
+    return value > 0 && std::isfinite(value);
+  }
+
+  // Whether the saved parameters are ones the command line could have set,
+  // so the grid and stencil built from them are well defined.
+  bool _valid_parameters(const Header &header) {
+    return header.cell_ratio >= 1 && header.cell_ratio <= MAX_CELL_RATIO
+        && _positive(header.support)
+        && _positive(header.time_step)
+        && _positive(header.particle_radius)
+        && _positive(header.rest_density);
+  }
+
+  std::expected<void, CheckpointError> load(const std::filesystem::path &path, Particles &ps, SimOpts &opts) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return std::unexpected(CheckpointError::Open);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      close(fd);
+      return std::unexpected(CheckpointError::Open);
+    }
+
+    uint64_t file_size = static_cast<uint64_t>(info.st_size);
+    if (file_size < sizeof(Header)) {
+      close(fd);
+      return std::unexpected(CheckpointError::Truncated);
+    }
+
+    void *mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      return std::unexpected(CheckpointError::Map);
+    }
+    madvise(mapping, file_size, MADV_SEQUENTIAL);
+
+    const char *bytes = static_cast<const char*>(mapping);
+    Header header;
+    std::memcpy(&header, bytes, sizeof(Header));
+
+    std::expected<void, CheckpointError> result;
+    uint64_t count = header.particle_count;
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+      result = std::unexpected(CheckpointError::BadMagic);
+    } else if (header.version != CHECKPOINT_VERSION) {
+      result = std::unexpected(CheckpointError::BadVersion);
+    } else if (header.file_size > file_size
+               || !_fits(header.pos_offset, count * sizeof(Vec3), file_size)
+               || !_fits(header.vel_offset, count * sizeof(Vec3), file_size)
+               || !_fits(header.density_offset, count * sizeof(float), file_size)
+               || !_fits(header.pressure_offset, count * sizeof(float), file_size)) {
+      result = std::unexpected(CheckpointError::Truncated);
+    } else if (!_valid_parameters(header)) {
+      result = std::unexpected(CheckpointError::BadParameters);
+    } else {
+      const Vec3 *pos = reinterpret_cast<const Vec3*>(bytes + header.pos_offset);
+      const Vec3 *vel = reinterpret_cast<const Vec3*>(bytes + header.vel_offset);
+      const float *density = reinterpret_cast<const float*>(bytes + header.density_offset);
+      const float *pressure = reinterpret_cast<const float*>(bytes + header.pressure_offset);
+
+      // NOTE: Copied in parallel in the OpenMP build, so the pages are
+      //       spread over the workers' NUMA nodes rather than all placed on
+      //       the loading thread's. This does not match the cell blocks the
+      //       force passes later take from the task pool, and the sequential
+      //       build copies (and first-touches) serially.
+      ps.resize(count);
+      #pragma omp parallel for schedule(static)
+      for (uint64_t i = 0; i < count; i++) {
+        ps.pos[i] = pos[i];
+        ps.vel[i] = vel[i];
+        ps.density[i] = density[i];
+        ps.pressure[i] = pressure[i];
+        ps.level[i] = 0;
+      }
+
+      opts.particle_count = header.particle_count;
+      opts.particle_radius = header.particle_radius;
+      opts.gas_constant = header.gas_constant;
+      opts.rest_density = header.rest_density;
+      opts.support = header.support;
+      opts.time_step = header.time_step;
+      opts.viscosity_constant = header.viscosity_constant;
+      opts.cell_ratio = header.cell_ratio;
+      opts.prune_stencil = header.prune_stencil != 0;
+    }
+
+    munmap(mapping, file_size);
+    return result;
+  }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "particles.h"
+#include "sim_opts.h"
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+
+constexpr uint32_t CHECKPOINT_VERSION = 2;
+
+namespace checkpoint {
+  enum class CheckpointError : uint32_t {
+    Open,
+    Map,
+    Write,
+    BadMagic,
+    BadVersion,
+    Truncated,
+    BadParameters,
+  };
+
+  const char *error_message(CheckpointError error);
+
+  /**
+   * Write the particle state and simulation parameters to `path`.
+   *
+   * NOTE: Only pos, vel, density and pressure are stored. The force arrays
+   *       are recomputed every step before they are read.
+   */
+  std::expected<void, CheckpointError> save(const std::filesystem::path &path, const Particles &ps, const SimOpts &opts);
+
+  /**
+   * Memory-map the checkpoint at `path` and copy it straight into `ps`.
+   * The simulation parameters saved with it replace those in `opts`; run
+   * settings (bench mode, threads, file paths) are left untouched.
+   * Parameters the command line would reject (a cell ratio outside
+   * [1, MAX_CELL_RATIO], or a support, time step, particle radius or rest
+   * density that is not positive) fail with `BadParameters`, and leave `ps`
+   * and `opts` untouched.
+   */
+  std::expected<void, CheckpointError> load(const std::filesystem::path &path, Particles &ps, SimOpts &opts);
+}
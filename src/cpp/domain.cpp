@@ -0,0 +1,332 @@
+#include "domain.h"
+
+#include "neighbours.h"
+#include "particles.h"
+#include "procs.h"
+#include "sim_opts.h"
+#include <algorithm>
+#include <cstdint>
+#include <mpi.h>
+#include <stdexcept>
+#include <vector>
+
+// Send `send` to `dest` while receiving `recv` from `source`. Either rank may
+// be MPI_PROC_NULL, which sends / receives nothing.
+template<typename T>
+void _sendrecv(const std::vector<T> &send, int dest, std::vector<T> &recv, int source, MPI_Comm comm) {
+  uint64_t send_count = send.size();
+  uint64_t recv_count = 0;
+  MPI_Sendrecv(
+    &send_count, 1, MPI_UINT64_T, dest, 0,
+    &recv_count, 1, MPI_UINT64_T, source, 0,
+    comm, MPI_STATUS_IGNORE
+  );
+
+  recv.resize(recv_count);
+  MPI_Sendrecv(
+    send.data(), send_count * sizeof(T), MPI_BYTE, dest, 1,
+    recv.data(), recv_count * sizeof(T), MPI_BYTE, source, 1,
+    comm, MPI_STATUS_IGNORE
+  );
+}
+
+// Append the interleaved position / velocity pairs in `pairs` to `ps`, along
+// with the interleaved density / pressure pairs in `fields` if there are any.
+void _append(Particles &ps, const std::vector<Vec3> &pairs, const std::vector<float> &fields = {}) {
+  size_t first = ps.size();
+  ps.resize(first + (pairs.size() / 2));
+  for (size_t i = 0; i < pairs.size() / 2; i++) {
+    ps.pos[first + i] = pairs[2 * i];
+    ps.vel[first + i] = pairs[(2 * i) + 1];
+  }
+  for (size_t i = 0; i < fields.size() / 2; i++) {
+    ps.density[first + i] = fields[2 * i];
+    ps.pressure[first + i] = fields[(2 * i) + 1];
+  }
+}
+
+Domain::Domain(MPI_Comm comm, const SimOpts &opts)
+: comm{comm},
+  opts{opts},
+  grid_width{Neighbours::grid_width_for(opts)},
+  ghost_layers{opts.cell_ratio} {
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &rank_count);
+
+  first_layer = (rank * grid_width) / rank_count;
+  last_layer = ((rank + 1) * grid_width) / rank_count;
+
+  // NOTE: Ghosts only come from the adjacent ranks, so every slab must be at
+  //       least as deep as the stencil reaches. Checks the thinnest slab so
+  //       that every rank agrees.
+  if (grid_width / rank_count < ghost_layers) {
+    throw std::runtime_error("Too many ranks for the neighbour grid");
+  }
+
+  // NOTE: `step` runs the plain passes, so options that change them would be
+  //       silently ignored.
+  if (opts.time_levels > 1 || opts.sleep_cells || opts.pressure_solver != PressureSolver::EquationOfState) {
+    throw std::runtime_error("Domain steps support neither time levels, sleeping cells nor PCISPH");
+  }
+
+  uint32_t layer_cells = grid_width * grid_width;
+  ns.set_active_cells(first_layer * layer_cells, last_layer * layer_cells);
+}
+
+uint32_t Domain::layer_of(Vec3 pos) const {
+  uint32_t x, y, z;
+  ns.cell_indexes(pos, grid_width, x, y, z);
+  return z;
+}
+
+void Domain::distribute(Particles &all, int root) {
+  uint64_t count = all.size();
+  MPI_Bcast(&count, 1, MPI_UINT64_T, root, comm);
+  if (rank != root) {
+    all.resize(count);
+  }
+  MPI_Bcast(all.pos.data(), count * sizeof(Vec3), MPI_BYTE, root, comm);
+  MPI_Bcast(all.vel.data(), count * sizeof(Vec3), MPI_BYTE, root, comm);
+  MPI_Bcast(all.density.data(), count * sizeof(float), MPI_BYTE, root, comm);
+  MPI_Bcast(all.pressure.data(), count * sizeof(float), MPI_BYTE, root, comm);
+
+  ps.clear();
+  for (size_t i = 0; i < all.size(); i++) {
+    uint32_t layer = layer_of(all.pos[i]);
+    if (layer >= first_layer && layer < last_layer) {
+      size_t next = ps.size();
+      ps.resize(next + 1);
+      ps.pos[next] = all.pos[i];
+      ps.vel[next] = all.vel[i];
+      ps.density[next] = all.density[i];
+      ps.pressure[next] = all.pressure[i];
+    }
+  }
+}
+
+void Domain::exchange_ghosts() {
+  int lower_rank = (rank > 0) ? rank - 1 : MPI_PROC_NULL;
+  int upper_rank = (rank < rank_count - 1) ? rank + 1 : MPI_PROC_NULL;
+
+  // NOTE: Ghosts go out in the order of the owned particles. Both sides sort
+  //       them with the same stable counting sort over the same cells, which
+  //       lets `exchange_ghost_fields` pair them up again by position alone.
+  send_lower.clear();
+  send_upper.clear();
+  for (size_t i = 0; i < ps.size(); i++) {
+    uint32_t layer = layer_of(ps.pos[i]);
+    if (layer < first_layer + ghost_layers) {
+      send_lower.push_back(ps.pos[i]);
+      send_lower.push_back(ps.vel[i]);
+    }
+    if (layer >= last_layer - ghost_layers) {
+      send_upper.push_back(ps.pos[i]);
+      send_upper.push_back(ps.vel[i]);
+    }
+  }
+
+  _sendrecv(send_lower, lower_rank, recv_upper, upper_rank, comm);
+  _sendrecv(send_upper, upper_rank, recv_lower, lower_rank, comm);
+
+  _append(ps, recv_lower);
+  _append(ps, recv_upper);
+}
+
+void Domain::exchange_ghost_fields() {
+  int lower_rank = (rank > 0) ? rank - 1 : MPI_PROC_NULL;
+  int upper_rank = (rank < rank_count - 1) ? rank + 1 : MPI_PROC_NULL;
+  uint32_t layer_cells = grid_width * grid_width;
+
+  // After sorting, lower ghosts come first, then the owned particles, then
+  // the upper ghosts.
+  uint32_t owned_begin = ns.cell_start(first_layer * layer_cells);
+  uint32_t owned_end = ns.cell_start(last_layer * layer_cells);
+  uint32_t lower_edge_end = ns.cell_start((first_layer + ghost_layers) * layer_cells);
+  uint32_t upper_edge_begin = ns.cell_start((last_layer - ghost_layers) * layer_cells);
+
+  send_lower_fields.clear();
+  for (uint32_t i = owned_begin; i < lower_edge_end; i++) {
+    send_lower_fields.push_back(ps.density[i]);
+    send_lower_fields.push_back(ps.pressure[i]);
+  }
+  send_upper_fields.clear();
+  for (uint32_t i = upper_edge_begin; i < owned_end; i++) {
+    send_upper_fields.push_back(ps.density[i]);
+    send_upper_fields.push_back(ps.pressure[i]);
+  }
+
+  _sendrecv(send_lower_fields, lower_rank, recv_upper_fields, upper_rank, comm);
+  _sendrecv(send_upper_fields, upper_rank, recv_lower_fields, lower_rank, comm);
+
+  if (recv_lower_fields.size() != 2 * owned_begin || recv_upper_fields.size() != 2 * (ps.size() - owned_end)) {
+    throw std::runtime_error("Ghost exchange out of step with the neighbouring ranks");
+  }
+
+  for (uint32_t i = 0; i < owned_begin; i++) {
+    ps.density[i] = recv_lower_fields[2 * i];
+    ps.pressure[i] = recv_lower_fields[(2 * i) + 1];
+  }
+  for (uint32_t i = owned_end; i < ps.size(); i++) {
+    ps.density[i] = recv_upper_fields[2 * (i - owned_end)];
+    ps.pressure[i] = recv_upper_fields[(2 * (i - owned_end)) + 1];
+  }
+}
+
+void Domain::keep_owned() {
+  uint32_t layer_cells = grid_width * grid_width;
+  uint32_t owned_begin = ns.cell_start(first_layer * layer_cells);
+  uint32_t owned_end = ns.cell_start(last_layer * layer_cells);
+
+  auto shift = [&](auto &field) {
+    std::copy(field.begin() + owned_begin, field.begin() + owned_end, field.begin());
+  };
+  shift(ps.pos);
+  shift(ps.vel);
+  shift(ps.force);
+#ifdef SPH_SPLIT_FORCES
+  shift(ps.pforce);
+  shift(ps.vforce);
+  shift(ps.eforce);
+#endif
+  shift(ps.density);
+  shift(ps.pressure);
+  shift(ps.level);
+  ps.resize(owned_end - owned_begin);
+}
+
+void Domain::migrate() {
+  int lower_rank = (rank > 0) ? rank - 1 : MPI_PROC_NULL;
+  int upper_rank = (rank < rank_count - 1) ? rank + 1 : MPI_PROC_NULL;
+
+  // A particle that crossed more than one slab in a step is passed along one
+  // rank per round. Densities and pressures go with it, so `gather` returns
+  // the values of the last density pass.
+  for (int round = 0; round < rank_count; round++) {
+    send_lower.clear();
+    send_upper.clear();
+    send_lower_fields.clear();
+    send_upper_fields.clear();
+
+    size_t kept = 0;
+    for (size_t i = 0; i < ps.size(); i++) {
+      uint32_t layer = layer_of(ps.pos[i]);
+      if (layer < first_layer) {
+        send_lower.push_back(ps.pos[i]);
+        send_lower.push_back(ps.vel[i]);
+        send_lower_fields.push_back(ps.density[i]);
+        send_lower_fields.push_back(ps.pressure[i]);
+      } else if (layer >= last_layer) {
+        send_upper.push_back(ps.pos[i]);
+        send_upper.push_back(ps.vel[i]);
+        send_upper_fields.push_back(ps.density[i]);
+        send_upper_fields.push_back(ps.pressure[i]);
+      } else {
+        ps.pos[kept] = ps.pos[i];
+        ps.vel[kept] = ps.vel[i];
+        ps.density[kept] = ps.density[i];
+        ps.pressure[kept] = ps.pressure[i];
+        kept += 1;
+      }
+    }
+    ps.resize(kept);
+
+    _sendrecv(send_lower, lower_rank, recv_upper, upper_rank, comm);
+    _sendrecv(send_upper, upper_rank, recv_lower, lower_rank, comm);
+    _sendrecv(send_lower_fields, lower_rank, recv_upper_fields, upper_rank, comm);
+    _sendrecv(send_upper_fields, upper_rank, recv_lower_fields, lower_rank, comm);
+    _append(ps, recv_lower, recv_lower_fields);
+    _append(ps, recv_upper, recv_upper_fields);
+
+    uint64_t sent = (send_lower.size() + send_upper.size()) / 2;
+    uint64_t moved = 0;
+    MPI_Allreduce(&sent, &moved, 1, MPI_UINT64_T, MPI_SUM, comm);
+    if (moved == 0) {
+      break;
+    }
+  }
+}
+
+void Domain::step() {
+  // NOTE: Runs the passes one by one, whatever `opts.task_graph` says.
+  exchange_ghosts();
+  opts.particle_count = ps.size();
+  ns.process(ps, opts);
+
+  particles::calculate_density_pressure(ps, ns, opts);
+  exchange_ghost_fields();
+  particles::calculate_pressure_forces(ps, ns, opts);
+  particles::calculate_viscosity_forces(ps, ns, opts);
+
+  keep_owned();
+  opts.particle_count = ps.size();
+  particles::integrate(ps, opts);
+
+  migrate();
+}
+
+void Domain::gather(Particles &all, int root) {
+  int bytes = ps.size() * sizeof(Vec3);
+  gather_bytes.resize(rank_count);
+  gather_offsets.resize(rank_count);
+  MPI_Gather(&bytes, 1, MPI_INT, gather_bytes.data(), 1, MPI_INT, root, comm);
+
+  if (rank == root) {
+    int total = 0;
+    for (int r = 0; r < rank_count; r++) {
+      gather_offsets[r] = total;
+      total += gather_bytes[r];
+    }
+    all.resize(total / sizeof(Vec3));
+  }
+
+  MPI_Gatherv(
+    ps.pos.data(), bytes, MPI_BYTE,
+    all.pos.data(), gather_bytes.data(), gather_offsets.data(), MPI_BYTE,
+    root, comm
+  );
+  MPI_Gatherv(
+    ps.vel.data(), bytes, MPI_BYTE,
+    all.vel.data(), gather_bytes.data(), gather_offsets.data(), MPI_BYTE,
+    root, comm
+  );
+
+  // Scalar fields take a third of the bytes of a vector field.
+  bytes = ps.size() * sizeof(float);
+  if (rank == root) {
+    for (int r = 0; r < rank_count; r++) {
+      gather_bytes[r] = (gather_bytes[r] / sizeof(Vec3)) * sizeof(float);
+      gather_offsets[r] = (gather_offsets[r] / sizeof(Vec3)) * sizeof(float);
+    }
+  }
+  MPI_Gatherv(
+    ps.density.data(), bytes, MPI_BYTE,
+    all.density.data(), gather_bytes.data(), gather_offsets.data(), MPI_BYTE,
+    root, comm
+  );
+  MPI_Gatherv(
+    ps.pressure.data(), bytes, MPI_BYTE,
+    all.pressure.data(), gather_bytes.data(), gather_offsets.data(), MPI_BYTE,
+    root, comm
+  );
+}
+
+bool Domain::sync_running(bool running) {
+  int flag = running ? 1 : 0;
+  MPI_Bcast(&flag, 1, MPI_INT, 0, comm);
+  return flag != 0;
+}
+
+uint64_t Domain::global_count() {
+  uint64_t local = ps.size();
+  uint64_t total = 0;
+  MPI_Allreduce(&local, &total, 1, MPI_UINT64_T, MPI_SUM, comm);
+  return total;
+}
+
+const Particles &Domain::particles() const {
+  return ps;
+}
+
+int Domain::rank_index() const {
+  return rank;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "neighbours.h"
+#include "particles.h"
+#include "sim_opts.h"
+#include <cstddef>
+#include <cstdint>
+#include <mpi.h>
+#include <vector>
+
+/**
+ * One MPI rank's share of a simulation split into slabs along z.
+ *
+ * Each rank owns the particles in a run of grid cell layers. Before the
+ * density pass, ranks swap the particles within stencil reach of their
+ * shared face (ghosts); after it, they swap the densities and pressures of
+ * those same particles so ghosts hold the values their owner computed.
+ * Particles that leave the slab during integration move to the neighbouring
+ * rank.
+ *
+ * Every method except the accessors is collective over the communicator.
+ */
+class Domain {
+  MPI_Comm comm;
+  int rank;
+  int rank_count;
+
+  SimOpts opts; // particle_count is the local particle plus ghost count.
+  Particles ps; // Owned particles, followed by ghosts during a step.
+  Neighbours ns;
+
+  uint32_t grid_width;
+  uint32_t ghost_layers;
+  uint32_t first_layer;
+  uint32_t last_layer; // exclusive
+
+  // Send / receive buffers, reused between steps.
+  std::vector<Vec3> send_lower, send_upper, recv_lower, recv_upper;
+  std::vector<float> send_lower_fields, send_upper_fields, recv_lower_fields, recv_upper_fields;
+  std::vector<int> gather_bytes, gather_offsets;
+
+  uint32_t layer_of(Vec3 pos) const;
+  void exchange_ghosts();
+  void exchange_ghost_fields();
+  void keep_owned();
+  void migrate();
+
+  public:
+    /**
+     * Throws if `opts` asks for more than one time level, sleeping cells or
+     * PCISPH, which the distributed step does not run.
+     */
+    Domain(MPI_Comm comm, const SimOpts &opts);
+
+    /**
+     * Send the positions, velocities, densities and pressures of `all` on
+     * rank `root` to every rank, and keep the particles that fall in this rank's slab. `all` is
+     * overwritten with rank `root`'s set on the other ranks.
+     */
+    void distribute(Particles &all, int root = 0);
+
+    /**
+     * Advance the whole simulation by one time step.
+     */
+    void step();
+
+    /**
+     * Collect every rank's positions, velocities, densities and pressures
+     * into `all` on rank `root`. Densities and pressures are those of the
+     * last step's density pass. Other fields of `all` are left uninitialized.
+     */
+    void gather(Particles &all, int root = 0);
+
+    /**
+     * Broadcast whether rank 0 wants to keep running. `running` is ignored on
+     * the other ranks.
+     */
+    bool sync_running(bool running);
+
+    uint64_t global_count();
+    const Particles &particles() const;
+    int rank_index() const;
+};
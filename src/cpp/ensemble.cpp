@@ -0,0 +1,83 @@
+#include "ensemble.h"
+
+#include "backend.h"
+#include "procs.h"
+#include "task_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+uint64_t _elapsed_nanos(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Ensemble::add(const SimOpts &opts) {
+  Member &member = members.emplace_back();
+  member.opts = opts;
+  member.ps.reset(opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+  member_costs.push_back(opts.particle_count);
+}
+
+size_t Ensemble::size() const {
+  return members.size();
+}
+
+void Ensemble::step(uint32_t steps) {
+  auto advance = [steps](Member &member, const SimOpts &opts) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < steps; i++) {
+      particles::step(member.ps, member.ns, opts);
+    }
+    member.steps += steps;
+    member.busy_nanos += _elapsed_nanos(start);
+  };
+
+  if (members.size() < task_pool().size()) {
+    for (Member &member : members) {
+      advance(member, member.opts);
+    }
+    return;
+  }
+
+  // NOTE: A member task already runs on a pool worker, so everything inside
+  //       it must stay off the pool: the serial backend, and no task graph.
+  task_pool().run(member_costs, [&](size_t m) {
+    SimOpts opts = members[m].opts;
+    opts.backend = exec::Backend::Serial;
+    opts.task_graph = false;
+    advance(members[m], opts);
+  });
+}
+
+MemberResult Ensemble::result(size_t m) const {
+  const Member &member = members[m];
+  const Particles &ps = member.ps;
+  size_t count = ps.size();
+
+  double density = 0;
+  double energy = 0;
+  float max_speed = 0;
+  for (size_t i = 0; i < count; i++) {
+    float speed_sqr = ps.vel[i].length_squared();
+    density += ps.density[i];
+    energy += 0.5 * speed_sqr;
+    max_speed = std::max(max_speed, speed_sqr);
+  }
+
+  return MemberResult{
+    .gas_constant = member.opts.gas_constant,
+    .viscosity_constant = member.opts.viscosity_constant,
+    .rest_density = member.opts.rest_density,
+    .steps = member.steps,
+    .millis_per_step = (member.steps > 0) ? (member.busy_nanos / 1e6) / member.steps : 0.0,
+    .mean_density = static_cast<float>((count > 0) ? density / count : 0.0),
+    .kinetic_energy = static_cast<float>((count > 0) ? energy / count : 0.0),
+    .max_speed = std::sqrt(max_speed),
+  };
+}
+
+const Particles &Ensemble::particles(size_t m) const {
+  return members[m].ps;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "neighbours.h"
+#include "particles.h"
+#include "sim_opts.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Summary of one ensemble member's state, for parameter sweeps.
+struct MemberResult {
+  float gas_constant;
+  float viscosity_constant;
+  float rest_density;
+  uint64_t steps;
+  double millis_per_step; // time spent stepping this member
+  float mean_density;
+  float kinetic_energy;   // mean, per unit mass
+  float max_speed;
+};
+
+/**
+ * Independent simulations stepped together on the shared task pool.
+ *
+ * With at least as many members as pool workers, each member is one task:
+ * it runs its steps serially on whichever worker picks it up, so its
+ * particles stay in that core's cache and members never wait on each other's
+ * pass barriers. Idle workers steal whole members. With fewer members than
+ * workers, members step one after another, each on every worker.
+ */
+class Ensemble {
+  struct Member {
+    SimOpts opts;
+    Particles ps;
+    Neighbours ns;
+    uint64_t steps = 0;
+    uint64_t busy_nanos = 0;
+  };
+
+  std::vector<Member> members;
+  std::vector<uint64_t> member_costs;
+
+  public:
+    /**
+     * Add a member starting from the usual initial block of particles.
+     */
+    void add(const SimOpts &opts);
+    size_t size() const;
+
+    /**
+     * Advance every member by `steps` time steps.
+     */
+    void step(uint32_t steps = 1);
+
+    MemberResult result(size_t member) const;
+    const Particles &particles(size_t member) const;
+};
@@ -0,0 +1,124 @@
+#include "ensemble.h"
+#include "sim_opts.h"
+#include "task_pool.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <print>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+constexpr uint32_t DEFAULT_PARTICLE_COUNT = 1024;
+
+// Parse a comma separated list of floats into `values`, leaving it untouched
+// if any entry is bad.
+void _parse_list(std::string_view list, std::vector<float> &values) {
+  std::vector<float> parsed;
+  while (!list.empty()) {
+    std::string_view entry = list.substr(0, list.find(','));
+    float value = 0.0f;
+    auto res = std::from_chars(entry.begin(), entry.end(), value);
+    if (res.ptr != entry.end() || entry.empty()) {
+      return;
+    }
+    parsed.push_back(value);
+    list.remove_prefix(std::min(entry.size() + 1, list.size()));
+  }
+
+  if (!parsed.empty()) {
+    values = parsed;
+  }
+}
+
+int main(int argc, const char **argv) {
+  std::filesystem::path exe_path(argv[0]);
+  SimOpts base_opts{
+    .bench_mode = true,
+    .particle_count = DEFAULT_PARTICLE_COUNT,
+    .particle_radius = PARTICLE_RADIUS,
+    .gas_constant = GAS_CONSTANT,
+    .rest_density = REST_DENSITY,
+    .support = SUPPORT,
+    .viscosity_constant = VISCOSITY_CONSTANT,
+  };
+  std::vector<float> gas_constants{GAS_CONSTANT};
+  std::vector<float> viscosity_constants{VISCOSITY_CONSTANT};
+  std::vector<float> rest_densities{REST_DENSITY};
+  uint32_t steps = BENCH_LENGTH;
+  uint32_t thread_count = std::thread::hardware_concurrency();
+
+  for (size_t i = 1; i < argc; i++) {
+    std::string_view arg(argv[i]);
+    if (arg.starts_with("--gas-constant=")) {
+      _parse_list(arg.substr(std::string_view("--gas-constant=").size()), gas_constants);
+    } else if (arg.starts_with("--viscosity-constant=")) {
+      _parse_list(arg.substr(std::string_view("--viscosity-constant=").size()), viscosity_constants);
+    } else if (arg.starts_with("--rest-density=")) {
+      _parse_list(arg.substr(std::string_view("--rest-density=").size()), rest_densities);
+    } else if (arg.starts_with("--steps=")) {
+      std::string_view value = arg.substr(std::string_view("--steps=").size());
+      uint32_t parsed = 0;
+      auto res = std::from_chars(value.begin(), value.end(), parsed);
+
+      if (res.ptr == value.end() && parsed > 0) {
+        steps = parsed;
+      }
+    } else if (arg.starts_with("--threads=")) {
+      std::string_view value = arg.substr(std::string_view("--threads=").size());
+      uint32_t parsed = 0;
+      auto res = std::from_chars(value.begin(), value.end(), parsed);
+
+      if (res.ptr == value.end() && parsed > 0) {
+        thread_count = parsed;
+      }
+    } else {
+      uint32_t particle_count = 0;
+      auto res = std::from_chars(arg.begin(), arg.end(), particle_count);
+
+      // If the entire arg was not consumed, default to a known good value.
+      if (res.ptr != arg.end() || particle_count % 64 != 0) {
+        particle_count = DEFAULT_PARTICLE_COUNT;
+      }
+      base_opts.particle_count = particle_count;
+    }
+  }
+
+  task_pool().resize(std::max(thread_count, 1u));
+
+  // One member per combination of the swept parameters.
+  Ensemble ensemble;
+  for (float gas_constant : gas_constants) {
+    for (float viscosity_constant : viscosity_constants) {
+      for (float rest_density : rest_densities) {
+        SimOpts opts = base_opts;
+        opts.gas_constant = gas_constant;
+        opts.viscosity_constant = viscosity_constant;
+        opts.rest_density = rest_density;
+        ensemble.add(opts);
+      }
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  ensemble.step(steps);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::println("member,gas_constant,viscosity_constant,rest_density,steps,ms_per_step,mean_density,kinetic_energy,max_speed");
+  for (size_t m = 0; m < ensemble.size(); m++) {
+    MemberResult result = ensemble.result(m);
+    std::println(
+      "{},{},{},{},{},{:.3f},{},{},{}",
+      m, result.gas_constant, result.viscosity_constant, result.rest_density, result.steps,
+      result.millis_per_step, result.mean_density, result.kinetic_energy, result.max_speed
+    );
+  }
+  std::println(
+    "# {} members on {} threads: {:.1f} member steps/s",
+    ensemble.size(), task_pool().size(), (ensemble.size() * steps) / seconds
+  );
+
+  return 0;
+}
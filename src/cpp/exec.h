@@ -0,0 +1,117 @@
+#pragma once
+
+#include "backend.h"
+#include "task_pool.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <execution>
+#include <iterator>
+#include <span>
+
+// Chunks per pool worker for uniform loops on the thread pool backend.
+constexpr size_t TASKS_PER_WORKER = 8;
+
+namespace exec {
+  // Random access iterator over the indexes [0, n), for the parallel
+  // algorithms.
+  class IndexIterator {
+    size_t index;
+
+    public:
+      using iterator_category = std::random_access_iterator_tag;
+      using value_type = size_t;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const size_t*;
+      // NOTE: A real reference (to the iterator's own index) keeps this a
+      //       forward iterator for the algorithms that check.
+      using reference = const size_t&;
+
+      IndexIterator() : index{0} { }
+      explicit IndexIterator(size_t index) : index{index} { }
+
+      reference operator*() const { return index; }
+      size_t operator[](difference_type n) const { return index + n; }
+
+      IndexIterator &operator++() { index += 1; return *this; }
+      IndexIterator operator++(int) { IndexIterator old = *this; index += 1; return old; }
+      IndexIterator &operator--() { index -= 1; return *this; }
+      IndexIterator operator--(int) { IndexIterator old = *this; index -= 1; return old; }
+      IndexIterator &operator+=(difference_type n) { index += n; return *this; }
+      IndexIterator &operator-=(difference_type n) { index -= n; return *this; }
+
+      friend IndexIterator operator+(IndexIterator it, difference_type n) { return it += n; }
+      friend IndexIterator operator+(difference_type n, IndexIterator it) { return it += n; }
+      friend IndexIterator operator-(IndexIterator it, difference_type n) { return it -= n; }
+      friend difference_type operator-(IndexIterator a, IndexIterator b) {
+        return static_cast<difference_type>(a.index) - static_cast<difference_type>(b.index);
+      }
+      friend auto operator<=>(IndexIterator a, IndexIterator b) = default;
+  };
+
+  /**
+   * Call `body(i)` for every `i` in [0, count). Iterations are cheap and
+   * uniform (per particle updates), and must not allocate or lock.
+   */
+  template<typename F>
+  void for_each_index(Backend backend, size_t count, F &&body) {
+    switch (backend) {
+      case Backend::Serial:
+        for (size_t i = 0; i < count; i++) {
+          body(i);
+        }
+        break;
+      case Backend::OpenMP:
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < count; i++) {
+          body(i);
+        }
+        break;
+      case Backend::StdPar:
+        std::for_each(std::execution::par_unseq, IndexIterator(0), IndexIterator(count), body);
+        break;
+      case Backend::ThreadPool: {
+        TaskPool &pool = task_pool();
+        size_t chunks = std::min(count, pool.size() * TASKS_PER_WORKER);
+        pool.run(chunks, [&](size_t chunk) {
+          size_t end = ((chunk + 1) * count) / chunks;
+          for (size_t i = (chunk * count) / chunks; i < end; i++) {
+            body(i);
+          }
+        });
+        break;
+      }
+    }
+  }
+
+  /**
+   * Call `body(i)` for every `i` in [0, costs.size()), where `costs[i]`
+   * estimates the relative cost of iteration `i`. Iterations may use the
+   * thread's frame arena.
+   */
+  template<typename F>
+  void for_each_block(Backend backend, std::span<const uint64_t> costs, F &&body) {
+    size_t count = costs.size();
+
+    switch (backend) {
+      case Backend::Serial:
+        for (size_t i = 0; i < count; i++) {
+          body(i);
+        }
+        break;
+      case Backend::OpenMP:
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < count; i++) {
+          body(i);
+        }
+        break;
+      case Backend::StdPar:
+        // NOTE: Not `par_unseq`, blocks allocate from the frame arena.
+        std::for_each(std::execution::par, IndexIterator(0), IndexIterator(count), body);
+        break;
+      case Backend::ThreadPool:
+        task_pool().run(costs, body);
+        break;
+    }
+  }
+}
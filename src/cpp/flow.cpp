@@ -0,0 +1,100 @@
+#include "flow.h"
+
+#include "particles.h"
+#include "sim_opts.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <libcommon/vec.h>
+#include <numbers>
+#include <span>
+
+namespace flow {
+  // SplitMix64 finalizer, to spread consecutive inputs over all the bits.
+  uint64_t _mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  }
+
+  // Uniform in [0, 1) from the top 24 bits.
+  float _unit(uint64_t bits) {
+    return static_cast<float>(bits >> 40) * (1.0f / (1u << 24));
+  }
+
+  uint32_t capacity(const SimOpts &opts) {
+    // NOTE: The GPU buffers take whole workgroups of 64, and a drained or
+    //       filled checkpoint restores a `particle_count` of any size.
+    uint32_t most = std::max(opts.particle_capacity, opts.particle_count);
+    return ((most + 63) / 64) * 64;
+  }
+
+  bool in_sink(Vec3 pos, std::span<const Sink> sinks) {
+    for (const Sink &sink : sinks) {
+      if (pos.x() >= sink.low.x() && pos.x() <= sink.high.x()
+          && pos.y() >= sink.low.y() && pos.y() <= sink.high.y()
+          && pos.z() >= sink.low.z() && pos.z() <= sink.high.z()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint32_t emit(Particles &ps, const SimOpts &opts, uint64_t step) {
+    uint32_t limit = capacity(opts);
+    size_t first = ps.size();
+    size_t wanted = 0;
+    for (const Emitter &emitter : opts.emitters) {
+      wanted += emitter.rate;
+    }
+
+    uint32_t count = std::min<size_t>(wanted, (first < limit) ? limit - first : 0);
+    if (count == 0) {
+      return 0;
+    }
+    ps.grow(count);
+
+    size_t i = first;
+    for (size_t e = 0; e < opts.emitters.size() && i < first + count; e++) {
+      const Emitter &emitter = opts.emitters[e];
+      for (uint32_t k = 0; k < emitter.rate && i < first + count; k++, i++) {
+        // Chained mixes rather than packed bit fields, which overlap once
+        // `k` reaches 2^24.
+        uint64_t bits = _mix(_mix(_mix(step) ^ e) ^ k);
+        // Uniform over the disc: the radius goes with the square root.
+        float r = emitter.radius * std::sqrt(_unit(bits));
+        float angle = 2 * std::numbers::pi_v<float> * _unit(_mix(bits));
+
+        ps.pos[i] = emitter.centre + Vec3{ r * std::cos(angle), 0, r * std::sin(angle) };
+        ps.vel[i] = emitter.velocity;
+        ps.force[i] = Vec3{ 0, 0, 0 };
+#ifdef SPH_SPLIT_FORCES
+        ps.pforce[i] = Vec3{ 0, 0, 0 };
+        ps.vforce[i] = Vec3{ 0, 0, 0 };
+        ps.eforce[i] = Vec3{ 0, 0, 0 };
+#endif
+        ps.density[i] = 0;
+        ps.pressure[i] = 0;
+        ps.level[i] = 0;
+      }
+    }
+    return count;
+  }
+
+  Emitter fountain_inlet(uint32_t rate) {
+    return Emitter{
+      .centre = Vec3{ 0, LOWER_BOUND + 0.05f, 0 },
+      .velocity = Vec3{ 0, 3.0f, 0 },
+      .radius = FOUNTAIN_WIDTH,
+      .rate = rate,
+    };
+  }
+
+  Sink corner_drain() {
+    return Sink{
+      .low = Vec3{ RIGHT_BOUND - 0.4f, LOWER_BOUND, FORWARD_BOUND - 0.4f },
+      .high = Vec3{ RIGHT_BOUND, LOWER_BOUND + 0.1f, FORWARD_BOUND },
+    };
+  }
+}
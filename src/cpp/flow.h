@@ -0,0 +1,41 @@
+#pragma once
+
+#include "particles.h"
+#include "sim_opts.h"
+#include <cstdint>
+#include <libcommon/vec.h>
+#include <span>
+
+/**
+ * Particles entering and leaving the simulation. Emitters append particles
+ * before a step. Sinks are applied by `Neighbours::sort`, which drops the
+ * particles inside them while it reorders the rest.
+ */
+namespace flow {
+  /**
+   * Most particles the simulation holds at once: `opts.particle_capacity`,
+   * but never fewer than the `opts.particle_count` it starts with, rounded
+   * up to a multiple of 64 for the GPU buffers.
+   */
+  uint32_t capacity(const SimOpts &opts);
+
+  bool in_sink(Vec3 pos, std::span<const Sink> sinks);
+
+  /**
+   * Append the particles `opts.emitters` release at `step`, stopping at
+   * `capacity(opts)`. Positions within each emitter's disc come from a hash
+   * of the step, so runs stay repeatable. Returns the number added.
+   */
+  uint32_t emit(Particles &ps, const SimOpts &opts, uint64_t step);
+
+  /**
+   * Feeds the fountain column from the floor, `rate` particles a step, in
+   * place of SimOpts::fountain_force.
+   */
+  Emitter fountain_inlet(uint32_t rate);
+
+  /**
+   * Drains the floor of one corner of the box.
+   */
+  Sink corner_drain();
+}
@@ -1,20 +1,138 @@
+#include "alloc.h"
+#include "backend.h"
+#include "flow.h"
 #include "sim.h"
 #include <filesystem>
 #include <print>
 
+#ifdef SPH_MPI
+#include "domain.h"
+#include "tuner.h"
+#include <mpi.h>
+#endif
+
 
 constexpr uint32_t DEFAULT_PARTICLE_COUNT = 1024;
 
 int main(int argc, const char **argv) {
   std::filesystem::path exe_path(argv[0]);
-  bool bench_mode = false;
-  uint32_t particle_count = DEFAULT_PARTICLE_COUNT;
+  SimOpts sim_opts{
+    .bench_mode = false,
+    .particle_count = DEFAULT_PARTICLE_COUNT,
+    .particle_radius = PARTICLE_RADIUS,
+    .gas_constant = GAS_CONSTANT,
+    .rest_density = REST_DENSITY,
+    .support = SUPPORT,
+    .viscosity_constant = VISCOSITY_CONSTANT,
+  };
 
+  bool time_step_given = false;
   for (size_t i = 1; i < argc; i++) {
     std::string_view arg(argv[i]);
     if (arg == "--bench") {
-      bench_mode = true;
+      sim_opts.bench_mode = true;
+    } else if (arg == "--auto-tune") {
+      sim_opts.auto_tune = true;
+    } else if (arg == "--pin-threads") {
+      sim_opts.pin_threads = true;
+    } else if (arg == "--thread-report") {
+      sim_opts.thread_report = true;
+    } else if (arg == "--huge-pages=transparent") {
+      alloc::set_page_mode(PageMode::Transparent);
+    } else if (arg == "--huge-pages=explicit") {
+      alloc::set_page_mode(PageMode::Explicit);
+    } else if (arg.starts_with("--backend=")) {
+      // Ignore unknown backends and keep the build's default.
+      auto backend = exec::parse_backend(arg.substr(std::string_view("--backend=").size()));
+      if (backend) {
+        sim_opts.backend = backend.value();
+      }
+    } else if (arg == "--reproducible") {
+      sim_opts.reproducible = true;
+    } else if (arg == "--task-graph") {
+      sim_opts.task_graph = true;
+    } else if (arg == "--sleep-cells") {
+      sim_opts.sleep_cells = true;
+    } else if (arg == "--prune-stencil") {
+      sim_opts.prune_stencil = true;
+    } else if (arg == "--fixed-point-cells") {
+      sim_opts.fixed_point_cells = true;
+    } else if (arg == "--tiled-cells") {
+      sim_opts.tiled_cells = true;
+    } else if (arg.starts_with("--load=")) {
+      sim_opts.load_path = arg.substr(std::string_view("--load=").size());
+    } else if (arg.starts_with("--save=")) {
+      sim_opts.save_path = arg.substr(std::string_view("--save=").size());
+    } else if (arg.starts_with("--record=")) {
+      sim_opts.record_path = arg.substr(std::string_view("--record=").size());
+    } else if (arg == "--record-velocity") {
+      sim_opts.record_fields |= TRAJ_VELOCITY;
+    } else if (arg == "--record-density") {
+      sim_opts.record_fields |= TRAJ_DENSITY;
+    } else if (arg.starts_with("--record-interval=")) {
+      std::string_view value = arg.substr(std::string_view("--record-interval=").size());
+      uint32_t interval = 0;
+      auto res = std::from_chars(value.begin(), value.end(), interval);
+
+      if (res.ptr == value.end() && interval > 0) {
+        sim_opts.record_interval = interval;
+      }
+    } else if (arg.starts_with("--inlet=")) {
+      std::string_view value = arg.substr(std::string_view("--inlet=").size());
+      uint32_t rate = 0;
+      auto res = std::from_chars(value.begin(), value.end(), rate);
+
+      if (res.ptr == value.end() && rate > 0) {
+        sim_opts.emitters.push_back(flow::fountain_inlet(rate));
+        sim_opts.fountain_force = false;
+      }
+    } else if (arg == "--drain") {
+      sim_opts.sinks.push_back(flow::corner_drain());
+    } else if (arg.starts_with("--capacity=")) {
+      std::string_view value = arg.substr(std::string_view("--capacity=").size());
+      uint32_t capacity = 0;
+      auto res = std::from_chars(value.begin(), value.end(), capacity);
+
+      // Sizes the GPU buffers, so it has the particle count's restriction.
+      if (res.ptr == value.end() && capacity % 64 == 0) {
+        sim_opts.particle_capacity = capacity;
+      }
+    } else if (arg.starts_with("--shm=")) {
+      sim_opts.shm_name = arg.substr(std::string_view("--shm=").size());
+    } else if (arg == "--shm-replace") {
+      sim_opts.shm_replace = true;
+    } else if (arg == "--headless") {
+      sim_opts.headless = true;
+    } else if (arg == "--pcisph") {
+      sim_opts.pressure_solver = PressureSolver::Pcisph;
+    } else if (arg.starts_with("--time-step=")) {
+      std::string_view value = arg.substr(std::string_view("--time-step=").size());
+      float time_step = 0;
+      auto res = std::from_chars(value.begin(), value.end(), time_step);
+
+      if (res.ptr == value.end() && time_step > 0) {
+        sim_opts.time_step = time_step;
+        time_step_given = true;
+      }
+    } else if (arg.starts_with("--time-levels=")) {
+      std::string_view value = arg.substr(std::string_view("--time-levels=").size());
+      uint32_t time_levels = 0;
+      auto res = std::from_chars(value.begin(), value.end(), time_levels);
+
+      if (res.ptr == value.end() && time_levels >= 1 && time_levels <= MAX_TIME_LEVELS) {
+        sim_opts.time_levels = time_levels;
+      }
+    } else if (arg.starts_with("--cell-ratio=")) {
+      std::string_view value = arg.substr(std::string_view("--cell-ratio=").size());
+      uint32_t cell_ratio = 0;
+      auto res = std::from_chars(value.begin(), value.end(), cell_ratio);
+
+      // Ignore bad ratios and keep the default one support wide cells.
+      if (res.ptr == value.end() && cell_ratio >= 1 && cell_ratio <= MAX_CELL_RATIO) {
+        sim_opts.cell_ratio = cell_ratio;
+      }
     } else {
+      uint32_t particle_count = 0;
       auto res = std::from_chars(arg.begin(), arg.end(), particle_count);
 
       // If the entire arg was not consumed, default to a known good value.
@@ -22,16 +140,82 @@ int main(int argc, const char **argv) {
       if (res.ptr != arg.end() || particle_count % 64 != 0) {
         particle_count = DEFAULT_PARTICLE_COUNT;
       }
+      sim_opts.particle_count = particle_count;
+    }
+  }
+  // PCISPH only pays for its corrections with larger steps.
+  if (sim_opts.pressure_solver == PressureSolver::Pcisph && !time_step_given) {
+    sim_opts.time_step = PCISPH_TIME_STEP;
+  }
+
+#ifdef SPH_MPI
+  // NOTE: Slabs only trade particles by migration, so the distributed build
+  //       keeps a fixed particle count.
+  sim_opts.emitters.clear();
+  sim_opts.sinks.clear();
+
+  // Domain steps run the plain passes on every rank.
+  if (sim_opts.time_levels > 1 || sim_opts.sleep_cells || sim_opts.pressure_solver != PressureSolver::EquationOfState) {
+    std::println("--time-levels, --sleep-cells and --pcisph are not supported by the distributed build");
+    return 1;
+  }
+
+  // Rank 0 renders and drives the loop; the other ranks run headless and
+  // only step their share of the domain.
+  MPI_Init(nullptr, nullptr);
+  int rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  try {
+    Domain domain(MPI_COMM_WORLD, sim_opts);
+    bool distributed = false;
+
+    if (rank == 0) {
+      Sim simulator(exe_path, sim_opts);
+      simulator.set_step_function([&](Particles &ps, Neighbours &ns, const SimOpts &opts) {
+        domain.sync_running(true);
+        if (!distributed) {
+          domain.distribute(ps);
+          distributed = true;
+        }
+        domain.step();
+        domain.gather(ps);
+      });
+
+      try {
+        simulator.init();
+        simulator.run_loop();
+      } catch(std::runtime_error err) {
+        std::println("Error");
+      }
+      domain.sync_running(false);
+    } else {
+      Particles all;
+      tuner::apply(sim_opts);
+      while (domain.sync_running(false)) {
+        if (!distributed) {
+          domain.distribute(all);
+          distributed = true;
+        }
+        domain.step();
+        domain.gather(all);
+      }
     }
+  } catch(std::runtime_error err) {
+    std::println("Error");
+    MPI_Abort(MPI_COMM_WORLD, 1);
   }
 
-  Sim simulator(exe_path, particle_count, bench_mode);
+  MPI_Finalize();
+#else
+  Sim simulator(exe_path, sim_opts);
   try {
     simulator.init();
     simulator.run_loop();
   } catch(std::runtime_error err) {
     std::println("Error");
   }
+#endif
 
   return 0;
 }
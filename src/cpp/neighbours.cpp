@@ -1,13 +1,249 @@
 #include "neighbours.h"
 
+#include "arena.h"
+#include "exec.h"
+#include "flow.h"
 #include "particles.h"
+#include "procs.h"
 #include "sim_opts.h"
+#include "task_pool.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
 #include <cmath>
 #include <cstdint>
 
-Neighbours::Neighbours() { }
+Neighbours::Neighbours()
+: block_count{0},
+  active_first_cell{0},
+  active_last_cell{UINT32_MAX},
+  sleep_enabled{false},
+  grid_width{0},
+  stencil_ratio{0},
+  stencil_pruned{false},
+  fixed_point_cells{false} { }
+
+uint32_t Neighbours::grid_width_for(const SimOpts &opts) {
+  uint32_t width = std::floorf((X_BOUNDS.y() - X_BOUNDS.x()) * opts.cell_ratio / opts.support);
+  return (width == 0) ? 1 : width;
+}
+
+void Neighbours::build_stencil(const SimOpts &opts) {
+  const int32_t k = static_cast<int32_t>(opts.cell_ratio);
+  const float cell_width = (X_BOUNDS.y() - X_BOUNDS.x()) / grid_width;
+  const float support_sqr = opts.support * opts.support;
+
+  stencil.clear();
+  for (int32_t z = -k; z <= k; z++) {
+    for (int32_t y = -k; y <= k; y++) {
+      for (int32_t x = -k; x <= k; x++) {
+        if (opts.prune_stencil) {
+          // Closest any point of the particle's cell can get to a point in the
+          // offset cell. If that is beyond the support, no particle in the
+          // offset cell can ever be a neighbour.
+          float dx = std::max(std::abs(x) - 1, 0) * cell_width;
+          float dy = std::max(std::abs(y) - 1, 0) * cell_width;
+          float dz = std::max(std::abs(z) - 1, 0) * cell_width;
+          if ((dx * dx) + (dy * dy) + (dz * dz) >= support_sqr) {
+            continue;
+          }
+        }
+        stencil.push_back(CellOffset{x, y, z});
+      }
+    }
+  }
+
+  stencil_ratio = opts.cell_ratio;
+  stencil_pruned = opts.prune_stencil;
+}
+
+void Neighbours::build_blocks(size_t workers, uint32_t max_cells) {
+  uint32_t cell_count = cell_starts.size() - 1;
+  uint32_t first_active = std::min(active_first_cell, cell_count);
+  uint32_t last_active = std::min(active_last_cell, cell_count);
+
+  // NOTE: Every particle of a cell interacts with roughly every other
+  //       particle in and around it, so a cell's cost grows with the square of
+  //       its occupancy. Dense cells (the fountain column, the floor) end up in
+  //       smaller blocks.
+  uint64_t total_cost = 0;
+  for (uint32_t cell = first_active; cell < last_active; cell++) {
+    if (cell_asleep(cell)) {
+      continue;
+    }
+    uint64_t occupancy = cell_starts[cell + 1] - cell_starts[cell];
+    total_cost += occupancy * (occupancy + 1);
+  }
+  uint64_t target_cost = std::max<uint64_t>(total_cost / (workers * BLOCKS_PER_WORKER), 1);
+
+  // Only reallocates when the grid changes shape.
+  if (blocks.size() != cell_count) {
+    blocks.resize(cell_count);
+    block_costs.resize(cell_count);
+  }
+
+  block_count = 0;
+  uint32_t first_cell = first_active;
+  uint64_t cost = 0;
+  // Emit the cells [first_cell, end_cell) as a block. Empty blocks are folded
+  // into the next one.
+  auto close_block = [&](uint32_t end_cell) {
+    if (cell_starts[end_cell] > cell_starts[first_cell]) {
+      blocks[block_count] = CellBlock{
+        .first_cell = first_cell,
+        .last_cell = end_cell,
+        .first_particle = cell_starts[first_cell],
+        .last_particle = cell_starts[end_cell],
+        .first_near_block = 0,
+        .last_near_block = 0,
+      };
+      block_costs[block_count] = cost;
+      block_count += 1;
+      first_cell = end_cell;
+      cost = 0;
+    }
+  };
+
+  for (uint32_t cell = first_active; cell < last_active; cell++) {
+    // Sleeping cells end the block before them and belong to none.
+    if (cell_asleep(cell)) {
+      close_block(cell);
+      first_cell = cell + 1;
+      cost = 0;
+      continue;
+    }
+
+    uint64_t occupancy = cell_starts[cell + 1] - cell_starts[cell];
+    cost += occupancy * (occupancy + 1);
+
+    uint32_t cells = cell + 1 - first_cell;
+    bool last = (cell + 1 == last_active);
+    if (cost >= target_cost || (max_cells > 0 && cells >= max_cells) || last) {
+      close_block(cell + 1);
+    }
+  }
+
+  // NOTE: Cells are numbered x fastest, so the stencil reaches at most
+  //       `reach` cells either side of a cell's index. Blocks are runs of
+  //       cells in index order, which makes the blocks near a block a run of
+  //       blocks too. This overestimates the neighbourhood, never misses any.
+  uint32_t reach = stencil_ratio * (1 + grid_width + (grid_width * grid_width));
+  size_t first_near = 0;
+  size_t last_near = 0;
+  for (size_t b = 0; b < block_count; b++) {
+    CellBlock &block = blocks[b];
+    while (blocks[first_near].last_cell + reach <= block.first_cell) {
+      first_near += 1;
+    }
+    while (last_near < block_count && blocks[last_near].first_cell < block.last_cell + reach) {
+      last_near += 1;
+    }
+    block.first_near_block = first_near;
+    block.last_near_block = last_near;
+  }
+}
+
+void Neighbours::set_active_cells(uint32_t first_cell, uint32_t last_cell) {
+  active_first_cell = first_cell;
+  active_last_cell = last_cell;
+}
+
+bool Neighbours::cell_asleep(uint32_t cell) const {
+  return sleep_enabled && still_steps[cell] >= SLEEP_STEPS;
+}
+
+void Neighbours::update_activity(const Particles &ps, float elapsed) {
+  uint32_t cell_count = cell_starts.size() - 1;
+  const int32_t width = static_cast<int32_t>(grid_width);
+
+  FrameArena &arena = frame_arena();
+  ArenaScope scope(arena);
+  std::span<uint8_t> moving = arena.alloc<uint8_t>(cell_count);
+  float max_displacement = SLEEP_SPEED * elapsed;
+  float max_velocity_change = SLEEP_ACCELERATION * elapsed;
+
+  for (uint32_t cell = 0; cell < cell_count; cell++) {
+    sleep_occupancy[cell] = cell_starts[cell + 1] - cell_starts[cell];
+    moving[cell] = false;
+    if (cell_asleep(cell)) {
+      continue;
+    }
+
+    // NOTE: Forces alone overstate the motion of particles held up by the
+    //       boundary, which cancels gravity without showing up in the force.
+    bool still = true;
+    for (uint32_t i = cell_starts[cell]; still && i < cell_starts[cell + 1]; i++) {
+      Vec3 displacement = ps.pos[i] - sleep_pos[i];
+      Vec3 velocity_change = ps.vel[i] - sleep_vel[i];
+      still = displacement.length_squared() < max_displacement * max_displacement
+           && velocity_change.length_squared() < max_velocity_change * max_velocity_change;
+    }
+    moving[cell] = !still;
+    still_steps[cell] = still ? std::min(still_steps[cell] + 1, SLEEP_STEPS) : 0;
+  }
+
+  // Moving particles disturb every cell they may reach.
+  for (uint32_t cell = 0; cell < cell_count; cell++) {
+    if (!moving[cell]) {
+      continue;
+    }
+
+    int32_t x = cell % grid_width;
+    int32_t y = (cell / grid_width) % grid_width;
+    int32_t z = cell / (grid_width * grid_width);
+    for (const CellOffset &offset : stencil) {
+      int32_t i = x + offset.x;
+      int32_t j = y + offset.y;
+      int32_t k = z + offset.z;
+      if (i < 0 || i >= width || j < 0 || j >= width || k < 0 || k >= width) {
+        continue;
+      }
+      still_steps[i + (j * grid_width) + (k * grid_width * grid_width)] = 0;
+    }
+  }
+}
+
+uint32_t Neighbours::cell_start(uint32_t cell) const {
+  return cell_starts[cell];
+}
+
+std::span<const CellBlock> Neighbours::cell_blocks() const {
+  return std::span(blocks).first(block_count);
+}
+
+std::span<const uint64_t> Neighbours::cell_block_costs() const {
+  return std::span(block_costs).first(block_count);
+}
+
+uint32_t Neighbours::fixed_point(float coordinate) {
+  const float SCALE = static_cast<float>(1u << FIXED_POINT_BITS) / (X_BOUNDS.y() - X_BOUNDS.x());
+  // NOTE: The largest float below 2^30. 2^30 - 1 itself rounds up to 2^30.
+  constexpr float MAX_FIXED = static_cast<float>((1u << FIXED_POINT_BITS) - 64);
+
+  // Clamping in float keeps the conversion a plain (vectorizable) truncation.
+  float scaled = (coordinate - X_BOUNDS.x()) * SCALE;
+  scaled = std::min(std::max(scaled, 0.0f), MAX_FIXED);
+  return static_cast<uint32_t>(static_cast<int32_t>(scaled));
+}
+
+uint32_t Neighbours::fixed_point_cell(uint32_t fixed, uint32_t grid_width) {
+  // fixed < 2^30, so this is below grid_width: no boundary fix-up needed.
+  return static_cast<uint32_t>((static_cast<uint64_t>(fixed) * grid_width) >> FIXED_POINT_BITS);
+}
+
+void Neighbours::set_fixed_point_cells(bool enabled) {
+  fixed_point_cells = enabled;
+}
 
 void Neighbours::cell_indexes(Vec3 pos, uint32_t grid_width, uint32_t &x, uint32_t &y, uint32_t &z) const {
+  if (fixed_point_cells) {
+    x = fixed_point_cell(fixed_point(pos.x()), grid_width);
+    y = fixed_point_cell(fixed_point(pos.y()), grid_width);
+    z = fixed_point_cell(fixed_point(pos.z()), grid_width);
+    return;
+  }
+
   // NOTE: Cube shaped simulation area centered on origin.
   //       Need to offset `pos` since calculations rely on positive numbers.
   const float SIM_AREA_WIDTH = X_BOUNDS.y() - X_BOUNDS.x();
@@ -34,14 +270,62 @@ uint32_t Neighbours::cell_index(Vec3 pos, uint32_t grid_width) const {
   return x + (grid_width * y) + (grid_width * grid_width * z);
 }
 
-void Neighbours::sort(Particles &ps, uint32_t particle_count, uint32_t grid_width) {
+std::array<uint32_t, 6> _canonical_key(Vec3 pos, Vec3 vel) {
+  return {
+    std::bit_cast<uint32_t>(pos.x()), std::bit_cast<uint32_t>(pos.y()), std::bit_cast<uint32_t>(pos.z()),
+    std::bit_cast<uint32_t>(vel.x()), std::bit_cast<uint32_t>(vel.y()), std::bit_cast<uint32_t>(vel.z()),
+  };
+}
+
+void Neighbours::sort(Particles &ps, uint32_t particle_count, uint32_t grid_width, exec::Backend backend, bool canonical, std::span<const Sink> sinks) {
   uint32_t bin_count = grid_width * grid_width * grid_width;
 
+  FrameArena &arena = frame_arena();
+  ArenaScope scope(arena);
+  std::span<uint32_t> count_array = arena.alloc<uint32_t>(bin_count + 1);
+  std::span<uint32_t> cells = arena.alloc<uint32_t>(particle_count);
+  std::span<Vec3> sorted_pos = arena.alloc<Vec3>(particle_count);
+  std::span<Vec3> sorted_vel = arena.alloc<Vec3>(particle_count);
+  std::span<Vec3> sorted_force = arena.alloc<Vec3>(particle_count);
+#ifdef SPH_SPLIT_FORCES
+  std::span<Vec3> sorted_pforce = arena.alloc<Vec3>(particle_count);
+  std::span<Vec3> sorted_vforce = arena.alloc<Vec3>(particle_count);
+  std::span<Vec3> sorted_eforce = arena.alloc<Vec3>(particle_count);
+#endif
+  std::span<float> sorted_density = arena.alloc<float>(particle_count);
+  std::span<float> sorted_pressure = arena.alloc<float>(particle_count);
+  std::span<uint8_t> sorted_level = arena.alloc<uint8_t>(particle_count);
+
   for (auto &c : count_array) { c = 0; }
 
+  // NOTE: Only the cell lookup and the copy back are parallel. Counting and
+  //       scattering stay serial to keep the sort stable.
+  if (fixed_point_cells) {
+    // Branch free per particle, so each chunk of this loop vectorizes.
+    exec::for_each_index(backend, particle_count, [&](size_t i) {
+      uint32_t x = fixed_point_cell(fixed_point(ps.pos[i].x()), grid_width);
+      uint32_t y = fixed_point_cell(fixed_point(ps.pos[i].y()), grid_width);
+      uint32_t z = fixed_point_cell(fixed_point(ps.pos[i].z()), grid_width);
+      cells[i] = x + (grid_width * y) + (grid_width * grid_width * z);
+    });
+  } else {
+    exec::for_each_index(backend, particle_count, [&](size_t i) {
+      cells[i] = cell_index(ps.pos[i], grid_width);
+    });
+  }
+
+  // Particles in a sink go to a bin past the last cell, so the scatter
+  // below also compacts the survivors.
+  if (!sinks.empty()) {
+    exec::for_each_index(backend, particle_count, [&](size_t i) {
+      if (flow::in_sink(ps.pos[i], sinks)) {
+        cells[i] = bin_count;
+      }
+    });
+  }
+
   for (size_t i = 0; i < particle_count; i++) {
-    uint32_t j = cell_index(ps.pos[i], grid_width);
-    count_array[j] += 1;
+    count_array[cells[i]] += 1;
   }
 
   for (size_t j = 1; j < (bin_count + 1); j++) {
@@ -55,74 +339,401 @@ void Neighbours::sort(Particles &ps, uint32_t particle_count, uint32_t grid_widt
   }
 
   for (int32_t i = (particle_count - 1); i >= 0; i--) {
-    uint32_t j = cell_index(ps.pos[i], grid_width);
+    uint32_t j = cells[i];
     count_array[j] -= 1;
-    sorted.pos[count_array[j]] = ps.pos[i];
-    sorted.vel[count_array[j]] = ps.vel[i];
-    sorted.pforce[count_array[j]] = ps.pforce[i];
-    sorted.vforce[count_array[j]] = ps.vforce[i];
-    sorted.eforce[count_array[j]] = ps.eforce[i];
-    sorted.density[count_array[j]] = ps.density[i];
-    sorted.pressure[count_array[j]] = ps.pressure[i];
+    sorted_pos[count_array[j]] = ps.pos[i];
+    sorted_vel[count_array[j]] = ps.vel[i];
+    sorted_force[count_array[j]] = ps.force[i];
+#ifdef SPH_SPLIT_FORCES
+    sorted_pforce[count_array[j]] = ps.pforce[i];
+    sorted_vforce[count_array[j]] = ps.vforce[i];
+    sorted_eforce[count_array[j]] = ps.eforce[i];
+#endif
+    sorted_density[count_array[j]] = ps.density[i];
+    sorted_pressure[count_array[j]] = ps.pressure[i];
+    sorted_level[count_array[j]] = ps.level[i];
   }
 
-  for (size_t i = 0; i < particle_count; i++) {
-    ps.pos[i] = sorted.pos[i];
-    ps.vel[i] = sorted.vel[i];
-    ps.pforce[i] = sorted.pforce[i];
-    ps.vforce[i] = sorted.vforce[i];
-    ps.eforce[i] = sorted.eforce[i];
-    ps.density[i] = sorted.density[i];
-    ps.pressure[i] = sorted.pressure[i];
+  uint32_t live_count = cell_starts[bin_count];
+
+  if (!canonical) {
+    exec::for_each_index(backend, live_count, [&](size_t i) {
+      ps.pos[i] = sorted_pos[i];
+      ps.vel[i] = sorted_vel[i];
+      ps.force[i] = sorted_force[i];
+#ifdef SPH_SPLIT_FORCES
+      ps.pforce[i] = sorted_pforce[i];
+      ps.vforce[i] = sorted_vforce[i];
+      ps.eforce[i] = sorted_eforce[i];
+#endif
+      ps.density[i] = sorted_density[i];
+      ps.pressure[i] = sorted_pressure[i];
+      ps.level[i] = sorted_level[i];
+    });
+    if (!sinks.empty()) {
+      ps.resize(live_count);
+    }
+    return;
+  }
+
+  // Order each cell by position then velocity (bit patterns), so the order
+  // neighbours are summed in no longer depends on the order particles
+  // arrived in: not on earlier steps, a checkpoint or the MPI rank count.
+  std::span<uint32_t> order = arena.alloc<uint32_t>(live_count);
+  exec::for_each_index(backend, bin_count, [&](size_t cell) {
+    uint32_t start = cell_starts[cell];
+    uint32_t end = cell_starts[cell + 1];
+    for (uint32_t i = start; i < end; i++) {
+      order[i] = i;
+    }
+    std::sort(order.begin() + start, order.begin() + end, [&](uint32_t a, uint32_t b) {
+      return _canonical_key(sorted_pos[a], sorted_vel[a]) < _canonical_key(sorted_pos[b], sorted_vel[b]);
+    });
+  });
+
+  exec::for_each_index(backend, live_count, [&](size_t i) {
+    uint32_t j = order[i];
+    ps.pos[i] = sorted_pos[j];
+    ps.vel[i] = sorted_vel[j];
+    ps.force[i] = sorted_force[j];
+#ifdef SPH_SPLIT_FORCES
+    ps.pforce[i] = sorted_pforce[j];
+    ps.vforce[i] = sorted_vforce[j];
+    ps.eforce[i] = sorted_eforce[j];
+#endif
+    ps.density[i] = sorted_density[j];
+    ps.pressure[i] = sorted_pressure[j];
+    ps.level[i] = sorted_level[j];
+  });
+  if (!sinks.empty()) {
+    ps.resize(live_count);
   }
 }
 
 void Neighbours::process(Particles &ps, const SimOpts & opts) {
-  uint32_t grid_width = std::floorf((X_BOUNDS.y() - X_BOUNDS.x()) / SUPPORT);
+  uint32_t new_grid_width = grid_width_for(opts);
+  if (new_grid_width != grid_width
+      || opts.cell_ratio != stencil_ratio
+      || opts.prune_stencil != stencil_pruned) {
+    grid_width = new_grid_width;
+    build_stencil(opts);
+  }
   uint32_t cell_count = grid_width * grid_width * grid_width;
 
-  sorted.resize(opts.particle_count);
-  count_array.resize(cell_count + 1);
-  cell_starts.resize(cell_count + 1);
+  // Only reallocates when the grid changes shape. Every cell starts awake.
+  if (cell_starts.size() != cell_count + 1) {
+    cell_starts.resize(cell_count + 1);
+    still_steps.assign(cell_count, 0);
+    sleep_occupancy.assign(cell_count, 0);
+  }
+  sleep_enabled = opts.sleep_cells;
+  fixed_point_cells = opts.fixed_point_cells;
 
-  sort(ps, opts.particle_count, grid_width);
-}
+  sort(ps, ps.size(), grid_width, opts.backend, opts.reproducible, opts.sinks);
 
-void Neighbours::neighbours_near(const Particles &ps, Vec3 pos, const SimOpts &opts, Particles &neighbours) {
-  uint32_t grid_width = std::floorf((X_BOUNDS.y() - X_BOUNDS.x()) / opts.support);
-  uint32_t x, y, z;
-  cell_indexes(pos, grid_width, x, y, z);
+  // Particles crossed into or out of any cell whose occupancy changed. Those
+  // of a sleeping cell never move, so for it that means one moved in.
+  if (sleep_enabled) {
+    for (uint32_t cell = 0; cell < cell_count; cell++) {
+      if (cell_starts[cell + 1] - cell_starts[cell] != sleep_occupancy[cell]) {
+        still_steps[cell] = 0;
+      }
+    }
 
-  int32_t x_start = static_cast<int32_t>(x) - 1;
-  int32_t y_start = static_cast<int32_t>(y) - 1;
-  int32_t z_start = static_cast<int32_t>(z) - 1;
-  int32_t x_end = x_start + 2;
-  int32_t y_end = y_start + 2;
-  int32_t z_end = z_start + 2;
-
-  // If the cell coordinates of the particle in question are at either extreme,
-  // (e.g. (0, 0, 0) or (grid_width, grid_width, grid_width)), the above
-  // offsets will push the starting index out of bounds.
-  x_start += (x_start == -1);
-  y_start += (y_start == -1);
-  z_start += (z_start == -1);
-  x_end -= (x_end == grid_width);
-  y_end -= (y_end == grid_width);
-  z_end -= (z_end == grid_width);
+    // Where each particle starts from, for `update_activity`.
+    sleep_pos.resize(ps.size());
+    sleep_vel.resize(ps.size());
+    std::copy(ps.pos.begin(), ps.pos.end(), sleep_pos.begin());
+    std::copy(ps.vel.begin(), ps.vel.end(), sleep_vel.begin());
+  }
+  build_blocks(task_pool().size(), opts.block_size);
+}
 
+void Neighbours::neighbours_near(const Particles &ps, Vec3 pos, Particles &neighbours) {
   neighbours.clear();
 
-  for (int32_t k = z_start; k <= z_end; k++) {
-    for (int32_t j = y_start; j <= y_end; j++) {
-      for (int32_t i = x_start; i <= x_end; i++) {
-        uint32_t cell = i + (j * grid_width) + (k * grid_width * grid_width);
-        uint32_t start_idx = cell_starts[cell];
-        uint32_t end_idx = cell_starts[cell + 1];
-        neighbours.pos.insert(neighbours.pos.end(), ps.pos.begin() + start_idx, ps.pos.begin() + end_idx);
-        neighbours.vel.insert(neighbours.vel.end(), ps.vel.begin() + start_idx, ps.vel.begin() + end_idx);
-        neighbours.density.insert(neighbours.density.end(), ps.density.begin() + start_idx, ps.density.begin() + end_idx);
-        neighbours.pressure.insert(neighbours.pressure.end(), ps.pressure.begin() + start_idx, ps.pressure.begin() + end_idx);
+  for_each_neighbour_cell(pos, [&](uint32_t start_idx, uint32_t end_idx) {
+    neighbours.pos.insert(neighbours.pos.end(), ps.pos.begin() + start_idx, ps.pos.begin() + end_idx);
+    neighbours.vel.insert(neighbours.vel.end(), ps.vel.begin() + start_idx, ps.vel.begin() + end_idx);
+    neighbours.density.insert(neighbours.density.end(), ps.density.begin() + start_idx, ps.density.begin() + end_idx);
+    neighbours.pressure.insert(neighbours.pressure.end(), ps.pressure.begin() + start_idx, ps.pressure.begin() + end_idx);
+  });
+}
+
+NeighbourList Neighbours::neighbours_near(const Particles &ps, Vec3 pos, FrameArena &arena) const {
+  size_t count = 0;
+  for_each_neighbour_cell(pos, [&count](uint32_t start_idx, uint32_t end_idx) {
+    count += end_idx - start_idx;
+  });
+
+  NeighbourList neighbours{
+    .pos = arena.alloc<Vec3>(count),
+    .vel = arena.alloc<Vec3>(count),
+    .density = arena.alloc<float>(count),
+    .pressure = arena.alloc<float>(count),
+  };
+
+  size_t next = 0;
+  for_each_neighbour_cell(pos, [&](uint32_t start_idx, uint32_t end_idx) {
+    std::copy(ps.pos.begin() + start_idx, ps.pos.begin() + end_idx, neighbours.pos.begin() + next);
+    std::copy(ps.vel.begin() + start_idx, ps.vel.begin() + end_idx, neighbours.vel.begin() + next);
+    std::copy(ps.density.begin() + start_idx, ps.density.begin() + end_idx, neighbours.density.begin() + next);
+    std::copy(ps.pressure.begin() + start_idx, ps.pressure.begin() + end_idx, neighbours.pressure.begin() + next);
+    next += end_idx - start_idx;
+  });
+
+  return neighbours;
+}
+
+// `pos` clamped onto the box, so points outside it look up its edge cells.
+static Vec3 _clamp_to_box(Vec3 pos) {
+  return {
+    std::clamp(pos.x(), X_BOUNDS.x(), X_BOUNDS.y()),
+    std::clamp(pos.y(), X_BOUNDS.x(), X_BOUNDS.y()),
+    std::clamp(pos.z(), X_BOUNDS.x(), X_BOUNDS.y()),
+  };
+}
+
+// Voxels of [first, last) along one axis whose centres are within `reach` of
+// `coordinate`, as [from, to).
+static void _voxels_within(float coordinate, float reach, float low, float spacing, uint32_t first, uint32_t last, uint32_t &from, uint32_t &to) {
+  float lowest = std::ceil((coordinate - reach - low) / spacing - 0.5f);
+  float highest = std::floor((coordinate + reach - low) / spacing - 0.5f) + 1.0f;
+  from = static_cast<uint32_t>(std::clamp(lowest, static_cast<float>(first), static_cast<float>(last)));
+  to = static_cast<uint32_t>(std::clamp(highest, static_cast<float>(from), static_cast<float>(last)));
+}
+
+void Neighbours::sample_fields(const Particles &ps, std::span<const Vec3> probes, std::span<float> density, std::span<Vec3> velocity, exec::Backend backend) const {
+  assert(density.size() == probes.size());
+  assert(velocity.empty() || velocity.size() == probes.size());
+  uint32_t cell_count = cell_starts.size() - 1;
+
+  FrameArena &arena = frame_arena();
+  ArenaScope scope(arena);
+  std::span<uint32_t> cells = arena.alloc<uint32_t>(probes.size());
+  std::span<uint32_t> order = arena.alloc<uint32_t>(probes.size());
+  std::span<uint32_t> probe_starts = arena.alloc<uint32_t>(cell_count + 1);
+  std::span<uint32_t> next = arena.alloc<uint32_t>(cell_count);
+  std::span<uint64_t> costs = arena.alloc<uint64_t>(cell_count);
+
+  exec::for_each_index(backend, probes.size(), [&](size_t p) {
+    cells[p] = cell_index(_clamp_to_box(probes[p]), grid_width);
+  });
+
+  // Counting sort of the probe indexes, like `sort` does for particles.
+  for (auto &s : probe_starts) { s = 0; }
+  for (size_t p = 0; p < probes.size(); p++) {
+    probe_starts[cells[p] + 1] += 1;
+  }
+  for (size_t j = 1; j < (cell_count + 1); j++) {
+    probe_starts[j] += probe_starts[j - 1];
+  }
+  std::copy(probe_starts.begin(), probe_starts.end() - 1, next.begin());
+  for (size_t p = 0; p < probes.size(); p++) {
+    order[next[cells[p]]++] = p;
+  }
+
+  for (uint32_t cell = 0; cell < cell_count; cell++) {
+    uint64_t candidates = 0;
+    for_each_neighbour_cell_of(cell, [&](uint32_t start_idx, uint32_t end_idx) {
+      candidates += end_idx - start_idx;
+    });
+    costs[cell] = candidates * (probe_starts[cell + 1] - probe_starts[cell]);
+  }
+
+  // Probes in cell order, so the inner loop below reads them contiguously.
+  std::span<Vec3> sorted_probes = arena.alloc<Vec3>(probes.size());
+  std::span<float> sorted_density = arena.alloc<float>(probes.size());
+  std::span<Vec3> sorted_velocity = arena.alloc<Vec3>(probes.size());
+  exec::for_each_index(backend, probes.size(), [&](size_t k) {
+    sorted_probes[k] = probes[order[k]];
+  });
+
+  // Each cell only writes its own probes.
+  exec::for_each_block(backend, costs, [&](size_t cell) {
+    uint32_t first = probe_starts[cell];
+    uint32_t last = probe_starts[cell + 1];
+    for (uint32_t k = first; k < last; k++) {
+      sorted_density[k] = 0;
+      sorted_velocity[k] = Vec3{0, 0, 0};
+    }
+    if (first == last) {
+      return;
+    }
+
+    // NOTE: Neighbours outside and probes inside, like the tiled passes.
+    //       The PolyKernel is inlined, and most candidates are beyond the
+    //       support, so they skip the velocity sum.
+    for_each_neighbour_cell_of(cell, [&](uint32_t start_idx, uint32_t end_idx) {
+      for (uint32_t j = start_idx; j < end_idx; j++) {
+        Vec3 particle = ps.pos[j];
+        Vec3 vel = ps.vel[j];
+        vel *= 1.0f / ps.density[j];
+        for (uint32_t k = first; k < last; k++) {
+          float q = (SUPPORT * SUPPORT) - (particle - sorted_probes[k]).length_squared();
+          if (q <= 0) {
+            continue;
+          }
+          float weight = q * q * q * particles::POLY_COEFFICIENT;
+          sorted_density[k] += weight;
+          sorted_velocity[k] += vel * weight;
+        }
+      }
+    });
+
+    for (uint32_t k = first; k < last; k++) {
+      density[order[k]] = sorted_density[k];
+      if (!velocity.empty()) {
+        velocity[order[k]] = sorted_velocity[k];
+      }
+    }
+  });
+}
+
+void Neighbours::sample_volume(const Particles &ps, const FieldVolume &volume, exec::Backend backend) const {
+  const uint32_t dims[3] = { volume.width, volume.height, volume.depth };
+  assert(volume.density.size() == size_t{dims[0]} * dims[1] * dims[2]);
+  assert(volume.velocity.empty() || volume.velocity.size() == volume.density.size());
+  if (dims[0] == 0 || dims[1] == 0 || dims[2] == 0) {
+    return;
+  }
+
+  FrameArena &arena = frame_arena();
+  ArenaScope scope(arena);
+
+  // Voxel centres along each axis, and the first voxel in each layer of grid
+  // cells along it. Both increase together, so every layer holds a run.
+  float spacing[3];
+  std::span<float> centres[3];
+  std::span<uint32_t> layer_starts[3];
+  for (int axis = 0; axis < 3; axis++) {
+    spacing[axis] = (volume.high.data[axis] - volume.low.data[axis]) / dims[axis];
+    centres[axis] = arena.alloc<float>(dims[axis]);
+    layer_starts[axis] = arena.alloc<uint32_t>(grid_width + 1);
+
+    for (auto &s : layer_starts[axis]) { s = 0; }
+    for (uint32_t v = 0; v < dims[axis]; v++) {
+      float centre = volume.low.data[axis] + ((v + 0.5f) * spacing[axis]);
+      uint32_t x, y, z;
+      cell_indexes(_clamp_to_box(Vec3{centre, centre, centre}), grid_width, x, y, z);
+      centres[axis][v] = centre;
+      layer_starts[axis][x + 1] += 1;
+    }
+    for (uint32_t layer = 1; layer < (grid_width + 1); layer++) {
+      layer_starts[axis][layer] += layer_starts[axis][layer - 1];
+    }
+  }
+
+  // Work is split into columns of grid cells along x, so every voxel row
+  // belongs to one column. The rows of cells a column's stencil reaches are
+  // the stencil's distinct (y, z) offsets, and each row of cells holds one
+  // contiguous run of sorted particles.
+  std::span<CellOffset> row_offsets = arena.alloc<CellOffset>(stencil.size());
+  size_t row_offset_count = 0;
+  for (const CellOffset &offset : stencil) {
+    auto seen = std::find_if(row_offsets.begin(), row_offsets.begin() + row_offset_count, [&](const CellOffset &row) {
+      return row.y == offset.y && row.z == offset.z;
+    });
+    if (seen == row_offsets.begin() + row_offset_count) {
+      row_offsets[row_offset_count++] = CellOffset{ 0, offset.y, offset.z };
+    }
+  }
+  row_offsets = row_offsets.first(row_offset_count);
+
+  const int32_t width = static_cast<int32_t>(grid_width);
+  auto for_each_row_near = [&](uint32_t column, auto &&visit) {
+    int32_t y = column % grid_width;
+    int32_t z = column / grid_width;
+    for (const CellOffset &offset : row_offsets) {
+      int32_t j = y + offset.y;
+      int32_t k = z + offset.z;
+      if (j < 0 || j >= width || k < 0 || k >= width) {
+        continue;
       }
+      uint32_t first_cell = (j * grid_width) + (k * grid_width * grid_width);
+      visit(cell_starts[first_cell], cell_starts[first_cell + grid_width]);
     }
+  };
+
+  uint32_t column_count = grid_width * grid_width;
+  std::span<uint64_t> costs = arena.alloc<uint64_t>(column_count);
+  for (uint32_t column = 0; column < column_count; column++) {
+    uint32_t rows = (layer_starts[1][(column % grid_width) + 1] - layer_starts[1][column % grid_width])
+                  * (layer_starts[2][(column / grid_width) + 1] - layer_starts[2][column / grid_width]);
+    uint64_t candidates = 0;
+    for_each_row_near(column, [&](uint32_t start_idx, uint32_t end_idx) {
+      candidates += end_idx - start_idx;
+    });
+    costs[column] = candidates * rows;
   }
+
+  auto row_of = [&](uint32_t y, uint32_t z) {
+    return static_cast<size_t>(dims[0]) * (y + (static_cast<size_t>(dims[1]) * z));
+  };
+
+  // Each column only writes its own voxel rows.
+  exec::for_each_block(backend, costs, [&](size_t column) {
+    const uint32_t first[3] = { 0, layer_starts[1][column % grid_width], layer_starts[2][column / grid_width] };
+    const uint32_t last[3] = { dims[0], layer_starts[1][(column % grid_width) + 1], layer_starts[2][(column / grid_width) + 1] };
+    for (uint32_t z = first[2]; z < last[2]; z++) {
+      for (uint32_t y = first[1]; y < last[1]; y++) {
+        std::fill_n(volume.density.begin() + row_of(y, z), dims[0], 0.0f);
+        if (!volume.velocity.empty()) {
+          std::fill_n(volume.velocity.begin() + row_of(y, z), dims[0], Vec3{0, 0, 0});
+        }
+      }
+    }
+    if (first[1] == last[1] || first[2] == last[2]) {
+      return;
+    }
+
+    // Scatter each candidate over the voxels of this column in the bounding
+    // box of its support, skipping rows that miss the support sphere. The
+    // PolyKernel is inlined, like in the tiled passes.
+    for_each_row_near(column, [&](uint32_t start_idx, uint32_t end_idx) {
+      for (uint32_t j = start_idx; j < end_idx; j++) {
+        Vec3 particle = ps.pos[j];
+        Vec3 vel = ps.vel[j];
+        vel *= 1.0f / ps.density[j];
+
+        uint32_t from[3], to[3];
+        for (int axis = 0; axis < 3; axis++) {
+          _voxels_within(particle.data[axis], SUPPORT, volume.low.data[axis], spacing[axis], first[axis], last[axis], from[axis], to[axis]);
+        }
+        for (uint32_t z = from[2]; z < to[2]; z++) {
+          float dz = centres[2][z] - particle.z();
+          float reach_z = (SUPPORT * SUPPORT) - (dz * dz);
+          if (reach_z <= 0) {
+            continue;
+          }
+
+          for (uint32_t y = from[1]; y < to[1]; y++) {
+            float dy = centres[1][y] - particle.y();
+            float reach_y = reach_z - (dy * dy);
+            if (reach_y <= 0) {
+              continue;
+            }
+
+            float *row_density = volume.density.data() + row_of(y, z);
+            if (volume.velocity.empty()) {
+              for (uint32_t x = from[0]; x < to[0]; x++) {
+                float dx = centres[0][x] - particle.x();
+                float q = std::max(reach_y - (dx * dx), 0.0f);
+                row_density[x] += q * q * q * particles::POLY_COEFFICIENT;
+              }
+              continue;
+            }
+            Vec3 *row_velocity = volume.velocity.data() + row_of(y, z);
+            for (uint32_t x = from[0]; x < to[0]; x++) {
+              float dx = centres[0][x] - particle.x();
+              float q = std::max(reach_y - (dx * dx), 0.0f);
+              float weight = q * q * q * particles::POLY_COEFFICIENT;
+              row_density[x] += weight;
+              row_velocity[x] += vel * weight;
+            }
+          }
+        }
+      }
+    });
+  });
 }
@@ -1,23 +1,258 @@
 #pragma once
 
+#include "alloc.h"
+#include "arena.h"
+#include "backend.h"
 #include "particles.h"
 #include "sim_opts.h"
+#include <cstddef>
 #include <cstdint>
 #include <libcommon/vec.h>
+#include <span>
 #include <vector>
 
+// Offset (in cells) from a particle's cell to a cell that is searched for
+// neighbours.
+struct CellOffset {
+  int32_t x;
+  int32_t y;
+  int32_t z;
+};
+
+// Number of cell blocks per task pool worker. More blocks give work
+// stealing more room to even out the load.
+constexpr uint32_t BLOCKS_PER_WORKER = 8;
+
+// A cell falls asleep once every particle in it has stayed below these speed
+// and acceleration limits for SLEEP_STEPS steps in a row. Both are measured
+// from how far each particle actually moved and how much its velocity
+// changed, boundary collisions included.
+constexpr float SLEEP_SPEED = 0.05f;
+constexpr float SLEEP_ACCELERATION = 0.5f;
+constexpr uint32_t SLEEP_STEPS = 30;
+
+// Fractional bits of fixed-point positions across the box (see
+// SimOpts::fixed_point_cells). 30 bits keep the quantized coordinates
+// non-negative int32 values, which SIMD float conversions produce directly.
+constexpr uint32_t FIXED_POINT_BITS = 30;
+
+// A run of consecutive grid cells and the (sorted) particles in them.
+struct CellBlock {
+  uint32_t first_cell;
+  uint32_t last_cell; // exclusive
+  uint32_t first_particle;
+  uint32_t last_particle; // exclusive
+  // Blocks holding every cell the stencil reaches from this block.
+  uint32_t first_near_block;
+  uint32_t last_near_block; // exclusive
+};
+
+// Copies of the neighbour data a force pass reads, backed by a FrameArena.
+struct NeighbourList {
+  std::span<Vec3> pos;
+  std::span<Vec3> vel;
+  std::span<float> density;
+  std::span<float> pressure;
+
+  size_t size() const { return pos.size(); }
+};
+
+// Caller owned dense grid of field samples over the box [low, high], taken
+// at voxel centres. Voxels are stored x fastest, then y, then z.
+struct FieldVolume {
+  Vec3 low;
+  Vec3 high;
+  uint32_t width;
+  uint32_t height;
+  uint32_t depth;
+  std::span<float> density; // width * height * depth voxels
+  std::span<Vec3> velocity; // As many voxels, or empty to skip velocities
+};
+
 class Neighbours {
-  Particles sorted;
-  std::vector<uint32_t> count_array;
-  std::vector<uint32_t> cell_starts;
+  ParticleArray<uint32_t> cell_starts;
+  std::vector<CellOffset> stencil;
+  ParticleArray<CellBlock> blocks;
+  ParticleArray<uint64_t> block_costs;
+  size_t block_count;
+  uint32_t active_first_cell;
+  uint32_t active_last_cell;
+  ParticleArray<uint32_t> still_steps;     // per cell
+  ParticleArray<uint32_t> sleep_occupancy; // per cell, at the last activity update
+  ParticleArray<Vec3> sleep_pos;           // per particle, at the last `process`
+  ParticleArray<Vec3> sleep_vel;           // per particle, at the last `process`
+  bool sleep_enabled;
+  uint32_t grid_width;
+  uint32_t stencil_ratio;
+  bool stencil_pruned;
+  bool fixed_point_cells;
+
+  void build_stencil(const SimOpts &opts);
+  void build_blocks(size_t workers, uint32_t max_cells);
+
+  // Call `visit(start, end)` for each stencil cell around cell (x, y, z).
+  template<typename F>
+  void visit_stencil(uint32_t x, uint32_t y, uint32_t z, F &visit) const {
+    const int32_t width = static_cast<int32_t>(grid_width);
+
+    for (const CellOffset &offset : stencil) {
+      int32_t i = static_cast<int32_t>(x) + offset.x;
+      int32_t j = static_cast<int32_t>(y) + offset.y;
+      int32_t k = static_cast<int32_t>(z) + offset.z;
+
+      // Cells of the stencil that fall outside the grid hold no particles.
+      if (i < 0 || i >= width || j < 0 || j >= width || k < 0 || k >= width) {
+        continue;
+      }
+
+      uint32_t cell = i + (j * grid_width) + (k * grid_width * grid_width);
+      visit(cell_starts[cell], cell_starts[cell + 1]);
+    }
+  }
 
   public:
     Neighbours();
 
+    /**
+     * Number of cells along each axis of the grid for the given support and
+     * cell ratio. Cells are never narrower than `support / cell_ratio`.
+     */
+    static uint32_t grid_width_for(const SimOpts &opts);
+
+    /**
+     * Quantize one coordinate to a FIXED_POINT_BITS fixed-point offset from
+     * the low bound of the box. Coordinates outside the box are clamped.
+     */
+    static uint32_t fixed_point(float coordinate);
+
+    /**
+     * Grid cell along one axis of a fixed-point coordinate: a multiply and a
+     * shift, always below `grid_width`.
+     */
+    static uint32_t fixed_point_cell(uint32_t fixed, uint32_t grid_width);
+
+    /**
+     * Find cells through `fixed_point` instead of float arithmetic. Set by
+     * `process` from SimOpts::fixed_point_cells.
+     */
+    void set_fixed_point_cells(bool enabled);
+
     void cell_indexes(Vec3 pos, uint32_t grid_width, uint32_t &x, uint32_t &y, uint32_t &z) const;
     uint32_t cell_index(Vec3 pos, uint32_t grid_width) const;
-    void sort(Particles &ps, uint32_t particle_count, uint32_t grid_width);
+    /**
+     * Stable counting sort of the first `particle_count` particles into
+     * grid cells. With `canonical`, particles within a cell are ordered by
+     * their position and velocity instead of their previous order.
+     * Particles inside any of `sinks` are sorted past the last cell and
+     * dropped, which shrinks `ps` (and needs `particle_count == ps.size()`).
+     */
+    void sort(
+      Particles &ps,
+      uint32_t particle_count,
+      uint32_t grid_width,
+      exec::Backend backend = exec::Backend::Serial,
+      bool canonical = false,
+      std::span<const Sink> sinks = {}
+    );
 
     void process(Particles &ps, const SimOpts &opts);
-    void neighbours_near(const Particles &ps, Vec3 pos, const SimOpts &opts, Particles &neighbours);
+
+    /**
+     * Cell blocks covering every particle, in cell order, rebuilt by
+     * `process`. Blocks are cut to roughly equal estimated cost, and hold at
+     * most `SimOpts::block_size` cells when that is non-zero.
+     */
+    std::span<const CellBlock> cell_blocks() const;
+
+    /**
+     * Estimated cost of each block of `cell_blocks()`.
+     */
+    std::span<const uint64_t> cell_block_costs() const;
+
+    /**
+     * Only build cell blocks over the cells [first_cell, last_cell), so the
+     * force passes skip every particle outside them. Defaults to all cells.
+     */
+    void set_active_cells(uint32_t first_cell, uint32_t last_cell);
+
+    /**
+     * Whether `cell` is asleep. Cell blocks skip sleeping cells, so the force
+     * passes neither update nor move their particles, while awake neighbours
+     * still see them. Always false unless `SimOpts::sleep_cells` is set.
+     */
+    bool cell_asleep(uint32_t cell) const;
+
+    /**
+     * Count the steps each awake cell has stayed still, after integration.
+     * `elapsed` is the simulated time integrated since `process`. A cell with
+     * a moving particle wakes every cell in its stencil, and a sleeping cell
+     * wakes on its own once a particle moves into it.
+     */
+    void update_activity(const Particles &ps, float elapsed);
+
+    /**
+     * Index of the first (sorted) particle in `cell`. `cell` may be one past
+     * the last cell, giving the particle count.
+     */
+    uint32_t cell_start(uint32_t cell) const;
+
+    void neighbours_near(const Particles &ps, Vec3 pos, Particles &neighbours);
+
+    /**
+     * Gather the neighbour candidates of `pos` into storage drawn from
+     * `arena`. The list is valid until the arena is rewound past it.
+     */
+    NeighbourList neighbours_near(const Particles &ps, Vec3 pos, FrameArena &arena) const;
+
+    /**
+     * SPH interpolated density (the PolyKernel sum) and velocity (the sum of
+     * `vel * W / density`) of `ps` at every probe. Probes are sorted into
+     * grid cells, so the probes of a cell share one pass over its neighbour
+     * cells, and cells run in parallel. `ps` must not have moved since
+     * `process`, and its densities must be up to date (as after
+     * `calculate_density_pressure`), since velocities divide by them.
+     * `density` holds one sample per probe, as does `velocity` unless it is
+     * empty, which skips velocities.
+     */
+    void sample_fields(
+      const Particles &ps,
+      std::span<const Vec3> probes,
+      std::span<float> density,
+      std::span<Vec3> velocity,
+      exec::Backend backend = exec::Backend::Serial
+    ) const;
+
+    /**
+     * `sample_fields` at every voxel of `volume`. Voxels already fall in
+     * runs per layer of grid cells along each axis, so no sort is needed.
+     * Each column of cells along x scatters its candidates over its own
+     * voxel rows, and a particle only visits the voxels around its support.
+     * The volume's spans must hold `width * height * depth` voxels. A 128^3
+     * volume over 8192 particles costs about seven serial steps, so it suits
+     * occasional exports rather than sampling every step.
+     */
+    void sample_volume(const Particles &ps, const FieldVolume &volume, exec::Backend backend = exec::Backend::Serial) const;
+
+    /**
+     * Call `visit(start, end)` with the (sorted) particle index range of
+     * every grid cell in the stencil around `pos`.
+     */
+    template<typename F>
+    void for_each_neighbour_cell(Vec3 pos, F &&visit) const {
+      uint32_t x, y, z;
+      cell_indexes(pos, grid_width, x, y, z);
+      visit_stencil(x, y, z, visit);
+    }
+
+    /**
+     * Like `for_each_neighbour_cell`, for every particle of grid `cell` at
+     * once.
+     */
+    template<typename F>
+    void for_each_neighbour_cell_of(uint32_t cell, F &&visit) const {
+      uint32_t x = cell % grid_width;
+      uint32_t y = (cell / grid_width) % grid_width;
+      uint32_t z = cell / (grid_width * grid_width);
+      visit_stencil(x, y, z, visit);
+    }
 };
@@ -1,27 +1,56 @@
 #include "particles.h"
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
-#include <ranges>
-#include <vector>
 
 void Particles::resize(size_t new_size) {
   pos.resize(new_size);
   vel.resize(new_size);
+  force.resize(new_size);
+#ifdef SPH_SPLIT_FORCES
   pforce.resize(new_size);
   vforce.resize(new_size);
   eforce.resize(new_size);
+#endif
   density.resize(new_size);
   pressure.resize(new_size);
+  level.resize(new_size);
+}
+
+void Particles::reserve(size_t capacity) {
+  pos.reserve(capacity);
+  vel.reserve(capacity);
+  force.reserve(capacity);
+#ifdef SPH_SPLIT_FORCES
+  pforce.reserve(capacity);
+  vforce.reserve(capacity);
+  eforce.reserve(capacity);
+#endif
+  density.reserve(capacity);
+  pressure.reserve(capacity);
+  level.reserve(capacity);
+}
+
+void Particles::grow(size_t count) {
+  size_t new_size = size() + count;
+  if (new_size > pos.capacity()) {
+    reserve(std::max(new_size, 2 * pos.capacity()));
+  }
+  resize(new_size);
 }
 
 void Particles::clear() {
   pos.clear();
   vel.clear();
+  force.clear();
+#ifdef SPH_SPLIT_FORCES
   pforce.clear();
   vforce.clear();
   eforce.clear();
+#endif
   density.clear();
   pressure.clear();
+  level.clear();
 }
 
 size_t Particles::size() const { return pos.size(); }
@@ -33,7 +62,13 @@ void Particles::reset(uint32_t count, float left_bound, float right_bound) {
 
   resize(count);
 
-  for (uint32_t i : std::views::iota(0u, count)) {
+  // NOTE: Filled in parallel in the OpenMP build, so the pages are spread
+  //       over the workers' NUMA nodes rather than all placed on the
+  //       calling thread's. Particles are re-sorted every step and the force
+  //       passes take cell blocks from the task pool, so this is not the
+  //       split they later work on. The sequential build fills serially.
+  #pragma omp parallel for schedule(static)
+  for (uint32_t i = 0; i < count; i++) {
     uint32_t x = i % length;
     uint32_t y = (i / length) % length;
     uint32_t z = i / (length * length);
@@ -43,10 +78,14 @@ void Particles::reset(uint32_t count, float left_bound, float right_bound) {
       start + (z * step),
     };
     vel[i] = Vec3{0, 0, 0};
+    force[i] = Vec3{0, 0, 0};
+#ifdef SPH_SPLIT_FORCES
     pforce[i] = Vec3{0, 0, 0};
     vforce[i] = Vec3{0, 0, 0};
     eforce[i] = Vec3{0, 0, 0};
+#endif
     density[i] = 0;
     pressure[i] = 0;
+    level[i] = 0;
   }
 }
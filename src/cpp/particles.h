@@ -1,9 +1,10 @@
 #pragma once
 
+#include "alloc.h"
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <libcommon/vec.h>
-#include <vector>
 
 constexpr float USABLE_SPACE_MODIFIER = 0.8f;
 constexpr float PARTICLE_RADIUS = 0.075f;
@@ -14,6 +15,9 @@ constexpr float VISCOSITY_CONSTANT = 0.1f;
 constexpr float GRAVITY_STRENGTH = 10.0f;
 constexpr float FOUNTAIN_WIDTH = 0.25;
 constexpr float FOUNTAIN_STRENGTH = 1.5;
+// Fraction of the support a particle may cover (by its speed or its
+// acceleration) in one step of its time step level.
+constexpr float CFL_FACTOR = 0.4f;
 
 // Simulation area bounds.
 constexpr float LEFT_BOUND = -1.0;
@@ -22,17 +26,55 @@ constexpr float LOWER_BOUND = -1.0;
 constexpr float UPPER_BOUND = 1.0;
 constexpr float BACKWARD_BOUND = -1.0;
 constexpr float FORWARD_BOUND = 1.0;
+// Where viewers park draw slots beyond the particle count.
+constexpr Vec3 HIDDEN_POSITION{1000.0f, 1000.0f, 1000.0f};
+
+/**
+ * Gravity, or with `fountain` the fountain's push up its column in the lower
+ * half of the box. Cheap enough to recompute wherever it is needed rather
+ * than store.
+ */
+inline Vec3 external_force(Vec3 pos, bool fountain) {
+  bool flow_up = fountain
+               && pos.y() < 0
+               && std::abs(pos.x()) < FOUNTAIN_WIDTH
+               && std::abs(pos.z()) < FOUNTAIN_WIDTH;
+  return flow_up ? Vec3{ 0, GRAVITY_STRENGTH * FOUNTAIN_STRENGTH, 0 } : Vec3{ 0, -GRAVITY_STRENGTH, 0 };
+}
 
 struct Particles {
-  std::vector<Vec3> pos;
-  std::vector<Vec3> vel;
-  std::vector<Vec3> pforce; // Pressure forces
-  std::vector<Vec3> vforce; // Viscosity forces
-  std::vector<Vec3> eforce; // External forces
-  std::vector<float> density;
-  std::vector<float> pressure;
+  ParticleArray<Vec3> pos;
+  ParticleArray<Vec3> vel;
+  ParticleArray<Vec3> force; // Pressure plus viscosity forces
+#ifdef SPH_SPLIT_FORCES
+  // Each force on its own as well, for inspection in debug builds.
+  ParticleArray<Vec3> pforce; // Pressure forces
+  ParticleArray<Vec3> vforce; // Viscosity forces
+  ParticleArray<Vec3> eforce; // External forces, as of the last integration
+#endif
+  ParticleArray<float> density;
+  ParticleArray<float> pressure;
+  ParticleArray<uint8_t> level; // Time step level, see SimOpts::time_levels
 
+  /**
+   * Resize every array. New elements are left uninitialized so that `reset`
+   * (or a loaded checkpoint) is the first to touch their memory.
+   */
   void resize(size_t new_size);
+
+  /**
+   * Reserve storage for `capacity` particles in every array, so the count can
+   * change up to it without reallocating.
+   */
+  void reserve(size_t capacity);
+
+  /**
+   * Append `count` uninitialized particles. Storage at least doubles
+   * whenever it runs out, so growth costs amortized constant time per
+   * particle.
+   */
+  void grow(size_t count);
+
   void clear();
   size_t size() const;
   void reset(uint32_t count, float left_bound, float right_bound);
@@ -0,0 +1,266 @@
+#include "player.h"
+
+#include "particles.h"
+#include "trajectory.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <format>
+#include <libcommon/lib.h>
+#include <libcommon/matrix.h>
+#include <libcommon/vec.h>
+#include <mutex>
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_gpu.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Player::Player(std::filesystem::path exe_path, PlayerOpts opts)
+: exe_path{exe_path},
+  opts{opts},
+  sdl_ctx{nullptr},
+  mapping{nullptr},
+  mapping_size{0},
+  header{},
+  position{0.0},
+  paused{false},
+  slots(PREFETCH_DEPTH),
+  wanted{},
+  wanted_count{0} { }
+
+Player::~Player() {
+  if (prefetcher.joinable()) {
+    prefetcher.request_stop();
+    wake.notify_all();
+    prefetcher.join();
+  }
+  if (sdl_ctx) {
+    libcommon::teardown(sdl_ctx);
+  }
+  if (mapping) {
+    munmap(const_cast<std::byte*>(mapping), mapping_size);
+  }
+}
+
+void Player::open(const std::filesystem::path &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error(std::format("Failed to open trajectory: {}", path.string()));
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(TrajectoryHeader)) {
+    close(fd);
+    throw std::runtime_error(std::format("Not a trajectory file: {}", path.string()));
+  }
+
+  mapping_size = static_cast<size_t>(info.st_size);
+  void *map = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    mapping_size = 0;
+    throw std::runtime_error(std::format("Failed to map trajectory: {}", path.string()));
+  }
+  mapping = static_cast<const std::byte*>(map);
+  madvise(map, mapping_size, MADV_SEQUENTIAL);
+
+  std::memcpy(&header, mapping, sizeof(TrajectoryHeader));
+  if (std::memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0
+      || header.version != TRAJECTORY_VERSION
+      || header.frame_size != trajectory::frame_size(header.capacity, header.fields)) {
+    throw std::runtime_error(std::format("Not a trajectory file: {}", path.string()));
+  }
+
+  // The header is only finalized once recording ends; trust the file size
+  // for recordings that were cut short.
+  uint64_t stored_frames = (mapping_size - sizeof(TrajectoryHeader)) / header.frame_size;
+  header.frame_count = std::min(header.frame_count == 0 ? stored_frames : header.frame_count, stored_frames);
+  if (header.frame_count == 0) {
+    throw std::runtime_error(std::format("Trajectory has no frames: {}", path.string()));
+  }
+
+  for (DecodedFrame &slot : slots) {
+    slot.pos.resize(header.capacity);
+  }
+  fallback.resize(header.capacity);
+
+  // NOTE: The GPU pipeline works in groups of 64 particles.
+  uint32_t draw_count = ((header.capacity + 63) / 64) * 64;
+  auto res = libcommon::initialize_and_setup(exe_path.parent_path().c_str(), draw_count);
+  if (!res) {
+    throw std::runtime_error(std::format("{}", res.error()));
+  }
+  sdl_ctx = res.value();
+  sdl_ctx->uniforms.gen_point_sprites.particle_radius = PARTICLE_RADIUS;
+  sdl_ctx->uniforms.gen_point_sprites.model_view = libcommon::matrix::translate_z(2.0f)
+                                                 * libcommon::matrix::rotation_x(-20);
+
+  position = static_cast<double>(std::min(opts.start, header.frame_count - 1));
+  request();
+  prefetcher = std::jthread([this](std::stop_token stop) { prefetch_frames(stop); });
+}
+
+const std::byte *Player::frame_data(uint64_t index) const {
+  return mapping + sizeof(TrajectoryHeader) + (index * header.frame_size);
+}
+
+uint64_t Player::current_frame() const {
+  return static_cast<uint64_t>(position);
+}
+
+void Player::request() {
+  {
+    std::lock_guard guard(lock);
+    wanted_count = trajectory::upcoming_frames(position, opts.rate, header.frame_count, opts.loop, wanted);
+  }
+  wake.notify_one();
+}
+
+uint64_t Player::wanted_rank(uint64_t frame) const {
+  for (size_t k = 0; k < wanted_count; k++) {
+    if (wanted[k] == frame) {
+      return k;
+    }
+  }
+  return UINT64_MAX;
+}
+
+void Player::prefetch_frames(std::stop_token stop) {
+  std::vector<Vec3> decoded(header.capacity);
+
+  while (!stop.stop_requested()) {
+    uint64_t target = UINT64_MAX;
+    {
+      std::unique_lock guard(lock);
+      auto next_missing = [this]() {
+        for (size_t k = 0; k < wanted_count; k++) {
+          uint64_t frame = wanted[k];
+          bool present = std::any_of(slots.begin(), slots.end(), [frame](const DecodedFrame &slot) {
+            return slot.index == frame;
+          });
+          if (!present) {
+            return frame;
+          }
+        }
+        return UINT64_MAX;
+      };
+
+      wake.wait(guard, stop, [&] { return (target = next_missing()) != UINT64_MAX; });
+      if (target == UINT64_MAX) {
+        return;
+      }
+    }
+
+    uint32_t count = trajectory::decode_positions(header, frame_data(target), decoded);
+
+    {
+      std::lock_guard guard(lock);
+      // Evict whichever slot playback will reach last (or never). There are
+      // as many slots as wanted frames, so a missing frame means at least one
+      // slot holds a frame that is no longer wanted.
+      DecodedFrame &victim = *std::max_element(slots.begin(), slots.end(), [this](const DecodedFrame &a, const DecodedFrame &b) {
+        return wanted_rank(a.index) < wanted_rank(b.index);
+      });
+      victim.index = target;
+      victim.count = count;
+      std::swap(victim.pos, decoded);
+    }
+  }
+}
+
+bool Player::copy_particles(libcommon::SDLCtx *sdl_ctx, SDL_GPUTransferBuffer *tbuf, const void *player_ctx) {
+  if (!player_ctx) {
+    return false;
+  }
+
+  // NOTE: The prefetch thread only swaps slot buffers under the lock, so the
+  //       lock is held while copying out of a slot.
+  Player *player = const_cast<Player*>(static_cast<const Player*>(player_ctx));
+  uint64_t frame = player->current_frame();
+  std::unique_lock guard(player->lock);
+
+  const Vec3 *pos = nullptr;
+  uint32_t count = 0;
+  for (const DecodedFrame &slot : player->slots) {
+    if (slot.index == frame) {
+      pos = slot.pos.data();
+      count = slot.count;
+      break;
+    }
+  }
+
+  if (!pos) {
+    // Prefetching fell behind (e.g. straight after a seek): decode in place.
+    guard.unlock();
+    count = trajectory::decode_positions(player->header, player->frame_data(frame), player->fallback);
+    pos = player->fallback.data();
+  }
+
+  Vec4 *mapping = static_cast<Vec4*>(SDL_MapGPUTransferBuffer(sdl_ctx->device, tbuf, true));
+  if (!mapping) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    mapping[i].copy_vec3(pos[i]);
+  }
+  for (uint32_t i = count; i < sdl_ctx->particle_count; i++) {
+    mapping[i].copy_vec3(HIDDEN_POSITION);
+  }
+
+  SDL_UnmapGPUTransferBuffer(sdl_ctx->device, tbuf);
+
+  return true;
+}
+
+bool Player::handle_events() {
+  SDL_Event ev;
+  while (SDL_PollEvent(&ev)) {
+    switch (ev.type) {
+      case SDL_EVENT_QUIT:
+        return false;
+      case SDL_EVENT_KEY_DOWN:
+        switch (ev.key.key) {
+          case SDLK_SPACE:
+            paused = !paused;
+            break;
+          case SDLK_LEFT:
+            position = std::max(0.0, position - SEEK_FRAMES);
+            break;
+          case SDLK_RIGHT:
+            position = std::min<double>(header.frame_count - 1, position + SEEK_FRAMES);
+            break;
+          case SDLK_HOME:
+            position = 0.0;
+            break;
+          case SDLK_UP:
+            opts.rate = std::min(opts.rate * 2.0f, MAX_PLAYBACK_RATE);
+            break;
+          case SDLK_DOWN:
+            opts.rate = std::max(opts.rate / 2.0f, 1.0f / MAX_PLAYBACK_RATE);
+            break;
+        }
+        break;
+    }
+  }
+  return true;
+}
+
+void Player::run_loop() {
+  bool run = true;
+  while (run) {
+    run = handle_events();
+
+    request();
+    libcommon::draw(sdl_ctx, copy_particles, this);
+
+    if (!paused) {
+      paused = !trajectory::advance_playback(position, opts.rate, header.frame_count, opts.loop);
+    }
+  }
+}
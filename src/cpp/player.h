@@ -0,0 +1,80 @@
+#pragma once
+
+#include "trajectory.h"
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <libcommon/lib.h>
+#include <libcommon/vec.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+constexpr uint32_t PREFETCH_DEPTH = 16; // decoded frames kept ahead of playback
+constexpr uint64_t SEEK_FRAMES = 60;
+constexpr float MAX_PLAYBACK_RATE = 64.0f;
+
+struct PlayerOpts {
+  float rate = 1.0f;     // recorded frames advanced per drawn frame
+  uint64_t start = 0;    // first frame shown
+  bool loop = false;
+};
+
+/**
+ * Plays back a recorded trajectory through libcommon without simulating.
+ * The file is memory-mapped; a prefetch thread decodes the frames playback
+ * will reach next so drawing only ever copies decoded positions.
+ */
+class Player {
+  struct DecodedFrame {
+    uint64_t index = UINT64_MAX;
+    uint32_t count = 0;
+    std::vector<Vec3> pos;
+  };
+
+  std::filesystem::path exe_path;
+  PlayerOpts opts;
+  libcommon::SDLCtx *sdl_ctx;
+
+  const std::byte *mapping;
+  size_t mapping_size;
+  TrajectoryHeader header;
+
+  double position;
+  bool paused;
+  std::vector<Vec3> fallback;
+
+  std::vector<DecodedFrame> slots;
+  std::array<uint64_t, PREFETCH_DEPTH> wanted; // frames playback shows next
+  size_t wanted_count;
+  std::mutex lock;
+  std::condition_variable_any wake;
+  std::jthread prefetcher;
+
+  uint64_t wanted_rank(uint64_t frame) const;
+  void prefetch_frames(std::stop_token stop);
+  const std::byte *frame_data(uint64_t index) const;
+  uint64_t current_frame() const;
+  void request();
+  bool handle_events();
+
+  static bool copy_particles(libcommon::SDLCtx *sdl_ctx, SDL_GPUTransferBuffer *tbuf, const void *player_ctx);
+
+  public:
+    Player(std::filesystem::path exe_path, PlayerOpts opts);
+    ~Player();
+
+    Player(const Player&) = delete;
+    Player& operator=(const Player&) = delete;
+
+    /**
+     * Map the trajectory file and set up rendering.
+     *
+     * @throws std::runtime_error if the file is not a usable trajectory or
+     *         SDL setup fails.
+     */
+    void open(const std::filesystem::path &path);
+    void run_loop();
+};
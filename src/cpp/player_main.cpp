@@ -0,0 +1,53 @@
+#include "player.h"
+#include <charconv>
+#include <filesystem>
+#include <print>
+#include <stdexcept>
+
+
+int main(int argc, const char **argv) {
+  std::filesystem::path exe_path(argv[0]);
+  std::filesystem::path trajectory_path;
+  PlayerOpts opts;
+
+  for (size_t i = 1; i < argc; i++) {
+    std::string_view arg(argv[i]);
+    if (arg == "--loop") {
+      opts.loop = true;
+    } else if (arg.starts_with("--rate=")) {
+      std::string_view value = arg.substr(std::string_view("--rate=").size());
+      float rate = 0.0f;
+      auto res = std::from_chars(value.begin(), value.end(), rate);
+
+      if (res.ptr == value.end() && rate > 0.0f && rate <= MAX_PLAYBACK_RATE) {
+        opts.rate = rate;
+      }
+    } else if (arg.starts_with("--start=")) {
+      std::string_view value = arg.substr(std::string_view("--start=").size());
+      uint64_t start = 0;
+      auto res = std::from_chars(value.begin(), value.end(), start);
+
+      if (res.ptr == value.end()) {
+        opts.start = start;
+      }
+    } else {
+      trajectory_path = arg;
+    }
+  }
+
+  if (trajectory_path.empty()) {
+    std::println("Usage: {} <trajectory> [--rate=R] [--start=FRAME] [--loop]", exe_path.filename().string());
+    return 1;
+  }
+
+  Player player(exe_path, opts);
+  try {
+    player.open(trajectory_path);
+    player.run_loop();
+  } catch(std::runtime_error err) {
+    std::println("Error: {}", err.what());
+    return 1;
+  }
+
+  return 0;
+}
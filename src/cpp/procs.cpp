@@ -1,9 +1,16 @@
 #include "procs.h"
 
+#include "arena.h"
 #include "sim_opts.h"
 #include "util.h"
 #include "neighbours.h"
+#include "exec.h"
+#include "task_pool.h"
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <span>
 
 #include <cstdio>
 
@@ -11,7 +18,7 @@ namespace particles {
   /*** Kernels ***/
   template<>
   float kernel<PolyKernel>(Vec3 &point, Vec3 &particle) {
-    static constexpr float COEFFICIENT = 315.0f / (64 * std::numbers::pi_v<float> * util::pow(SUPPORT, 9));
+    static constexpr float COEFFICIENT = POLY_COEFFICIENT;
 
     float distsqr = (particle - point).length_squared();
     float q = (SUPPORT * SUPPORT) - distsqr;
@@ -21,9 +28,25 @@ namespace particles {
     return (q * q * q * COEFFICIENT);
   }
 
+  template<>
+  Vec3 kernel<PolyGradKernel>(Vec3 &point, Vec3 &particle) {
+    static constexpr float COEFFICIENT = -945.0f / (32 * std::numbers::pi_v<float> * util::pow(SUPPORT, 9));
+
+    Vec3 difference = particle - point;
+    float q = (SUPPORT * SUPPORT) - difference.length_squared();
+
+    if (q < 0) {
+      return { 0, 0, 0 };
+    }
+
+    // Like the spiky gradient, taken with respect to `particle`.
+    difference *= q * q * COEFFICIENT;
+    return difference;
+  }
+
   template<>
   Vec3 kernel<SpikyGradKernel>(Vec3 &point, Vec3 &particle) {
-    static constexpr float COEFFICIENT = -45.0f / (std::numbers::pi_v<float> * util::pow(SUPPORT, 6));
+    static constexpr float COEFFICIENT = SPIKY_GRAD_COEFFICIENT;
 
     Vec3 difference = particle - point;
     float dist = difference.length();
@@ -42,7 +65,7 @@ namespace particles {
 
   template<>
   float kernel<ViscLaplKernel>(Vec3 &point, Vec3 &particle) {
-    static constexpr float COEFFICIENT = 45.0f / (std::numbers::pi_v<float> * util::pow(SUPPORT, 6));
+    static constexpr float COEFFICIENT = VISC_LAPL_COEFFICIENT;
 
     float dist = (particle - point).length();
     float q = SUPPORT - dist;
@@ -51,116 +74,811 @@ namespace particles {
     return q * COEFFICIENT;
   }
 
-  /*** Force Calculations ***/
-  void calculate_density_pressure(Particles &ps, Neighbours &ns, const SimOpts &opts) {
-    static Particles neighbours;
-    static uint32_t grid_width = std::floorf(2.0f / opts.support);
-    size_t particle_count = opts.particle_count;
+  /*** Tiled Cell Pairs ***/
+  // Structure of arrays copy of up to TILE_SIZE consecutive particles.
+  struct _Tile {
+    alignas(64) float x[TILE_SIZE];
+    alignas(64) float y[TILE_SIZE];
+    alignas(64) float z[TILE_SIZE];
+    alignas(64) float vx[TILE_SIZE];
+    alignas(64) float vy[TILE_SIZE];
+    alignas(64) float vz[TILE_SIZE];
+    alignas(64) float density[TILE_SIZE];
+    alignas(64) float pressure[TILE_SIZE];
+    uint32_t count;
+  };
 
-    for (size_t i = 0; i < particle_count; i++) {
-      ns.neighbours_near(ps, ps.pos[i], opts, neighbours);
+  // Per target sums of one pass, for the tile being computed.
+  struct _TileSums {
+    alignas(64) float x[TILE_SIZE];
+    alignas(64) float y[TILE_SIZE];
+    alignas(64) float z[TILE_SIZE];
+  };
 
-      ps.density[i] = 0.0;
-      ps.pressure[i] = 0.0;
+  void _stage(_Tile &tile, const Particles &ps, size_t first, size_t last, bool fields) {
+    tile.count = last - first;
+    for (uint32_t t = 0; t < tile.count; t++) {
+      tile.x[t] = ps.pos[first + t].x();
+      tile.y[t] = ps.pos[first + t].y();
+      tile.z[t] = ps.pos[first + t].z();
+    }
+    if (!fields) {
+      return;
+    }
+    for (uint32_t t = 0; t < tile.count; t++) {
+      tile.vx[t] = ps.vel[first + t].x();
+      tile.vy[t] = ps.vel[first + t].y();
+      tile.vz[t] = ps.vel[first + t].z();
+      tile.density[t] = ps.density[first + t];
+      tile.pressure[t] = ps.pressure[first + t];
+    }
+  }
+
+  // NOTE: The micro-kernels loop over neighbours outside and targets inside.
+  //       Each target's sum then only depends on earlier neighbours, so the
+  //       inner loop vectorizes without reassociating the sums, and they are
+  //       added in the same order as the per particle passes.
+  void _tile_density(const _Tile &targets, const _Tile &near, _TileSums &sums) {
+    for (uint32_t n = 0; n < near.count; n++) {
+      for (uint32_t t = 0; t < targets.count; t++) {
+        float dx = near.x[n] - targets.x[t];
+        float dy = near.y[n] - targets.y[t];
+        float dz = near.z[n] - targets.z[t];
+        float q = std::max((SUPPORT * SUPPORT) - ((dx * dx) + (dy * dy) + (dz * dz)), 0.0f);
+        sums.x[t] += q * q * q * POLY_COEFFICIENT;
+      }
+    }
+  }
+
+  void _tile_pressure(const _Tile &targets, const _Tile &near, _TileSums &sums) {
+    for (uint32_t n = 0; n < near.count; n++) {
+      for (uint32_t t = 0; t < targets.count; t++) {
+        float dx = near.x[n] - targets.x[t];
+        float dy = near.y[n] - targets.y[t];
+        float dz = near.z[n] - targets.z[t];
+        float dist = std::sqrt((dx * dx) + (dy * dy) + (dz * dz));
+        float q = SUPPORT - dist;
+        float factor = (targets.pressure[t] + near.pressure[n]) / (2 * near.density[n]);
+        float scale = (q > 0 && dist > 0) ? (q * q * SPIKY_GRAD_COEFFICIENT) * (1.0f / dist) * factor : 0.0f;
+        sums.x[t] += dx * scale;
+        sums.y[t] += dy * scale;
+        sums.z[t] += dz * scale;
+      }
+    }
+  }
 
-      for (size_t j = 0; j < neighbours.size(); j++) {
-        ps.density[i] += kernel<PolyKernel>(ps.pos[i], neighbours.pos[j]);
+  void _tile_viscosity(const _Tile &targets, const _Tile &near, float viscosity_constant, _TileSums &sums) {
+    for (uint32_t n = 0; n < near.count; n++) {
+      for (uint32_t t = 0; t < targets.count; t++) {
+        float dx = near.x[n] - targets.x[t];
+        float dy = near.y[n] - targets.y[t];
+        float dz = near.z[n] - targets.z[t];
+        float q = std::max(SUPPORT - std::sqrt((dx * dx) + (dy * dy) + (dz * dz)), 0.0f);
+        float scale = viscosity_constant * (q * VISC_LAPL_COEFFICIENT) * (1.0f / near.density[n]);
+        sums.x[t] += (near.vx[n] - targets.vx[t]) * scale;
+        sums.y[t] += (near.vy[n] - targets.vy[t]) * scale;
+        sums.z[t] += (near.vz[n] - targets.vz[t]) * scale;
       }
-      ps.pressure[i] = opts.gas_constant * (ps.density[i] - opts.rest_density);
     }
   }
 
+  // Run `interact(targets, near, sums)` for every tile of every cell in
+  // `block` against every tile of its stencil cells, then `store(first,
+  // targets, sums)` the sums of each target tile.
+  template<typename Interact, typename Store>
+  void _for_each_tile_pair(const Particles &ps, const Neighbours &ns, const CellBlock &block, bool fields,
+                           Interact &&interact, Store &&store) {
+    FrameArena &arena = frame_arena();
+    ArenaScope scope(arena);
+    _Tile &targets = arena.alloc<_Tile>(1)[0];
+    _Tile &near = arena.alloc<_Tile>(1)[0];
+    _TileSums &sums = arena.alloc<_TileSums>(1)[0];
+
+    for (uint32_t cell = block.first_cell; cell < block.last_cell; cell++) {
+      size_t cell_end = ns.cell_start(cell + 1);
+      for (size_t first = ns.cell_start(cell); first < cell_end; first += TILE_SIZE) {
+        _stage(targets, ps, first, std::min<size_t>(first + TILE_SIZE, cell_end), fields);
+        std::fill_n(sums.x, targets.count, 0.0f);
+        std::fill_n(sums.y, targets.count, 0.0f);
+        std::fill_n(sums.z, targets.count, 0.0f);
+
+        ns.for_each_neighbour_cell_of(cell, [&](uint32_t start_idx, uint32_t end_idx) {
+          for (size_t near_first = start_idx; near_first < end_idx; near_first += TILE_SIZE) {
+            _stage(near, ps, near_first, std::min<size_t>(near_first + TILE_SIZE, end_idx), fields);
+            interact(targets, near, sums);
+          }
+        });
+        store(first, targets, sums);
+      }
+    }
+  }
+
+  void _tiled_density_pressure(Particles &ps, const Neighbours &ns, const SimOpts &opts, const CellBlock &block) {
+    _for_each_tile_pair(ps, ns, block, false, _tile_density, [&](size_t first, const _Tile &targets, const _TileSums &sums) {
+      for (uint32_t t = 0; t < targets.count; t++) {
+        ps.density[first + t] = sums.x[t];
+        if (opts.pressure_solver == PressureSolver::EquationOfState) {
+          ps.pressure[first + t] = opts.gas_constant * (sums.x[t] - opts.rest_density);
+        }
+      }
+    });
+  }
+
+  void _tiled_pressure_forces(Particles &ps, const Neighbours &ns, const CellBlock &block) {
+    _for_each_tile_pair(ps, ns, block, true, _tile_pressure, [&](size_t first, const _Tile &targets, const _TileSums &sums) {
+      for (uint32_t t = 0; t < targets.count; t++) {
+        ps.force[first + t] = Vec3{ sums.x[t], sums.y[t], sums.z[t] };
+#ifdef SPH_SPLIT_FORCES
+        ps.pforce[first + t] = ps.force[first + t];
+#endif
+      }
+    });
+  }
+
+  void _tiled_viscosity_forces(Particles &ps, const Neighbours &ns, const SimOpts &opts, const CellBlock &block) {
+    auto interact = [&](const _Tile &targets, const _Tile &near, _TileSums &sums) {
+      _tile_viscosity(targets, near, opts.viscosity_constant, sums);
+    };
+    _for_each_tile_pair(ps, ns, block, true, interact, [&](size_t first, const _Tile &targets, const _TileSums &sums) {
+      for (uint32_t t = 0; t < targets.count; t++) {
+        Vec3 viscosity{ sums.x[t], sums.y[t], sums.z[t] };
+        ps.force[first + t] += viscosity;
+#ifdef SPH_SPLIT_FORCES
+        ps.vforce[first + t] = viscosity;
+#endif
+      }
+    });
+  }
+
+  /*** Force Calculations ***/
+  // NOTE: The neighbour-summing passes run over cell blocks rather than over
+  //       particles, since cell occupancy (and so the cost
+  //       per particle) varies widely across the grid.
+  void _density_pressure_of(Particles &ps, const Neighbours &ns, const SimOpts &opts, size_t i) {
+    // NOTE: Only neighbour positions are read here. Other blocks write
+    //       density and pressure concurrently, so they must not be gathered.
+    float density = 0.0;
+    ns.for_each_neighbour_cell(ps.pos[i], [&](uint32_t start_idx, uint32_t end_idx) {
+      for (size_t j = start_idx; j < end_idx; j++) {
+        density += kernel<PolyKernel>(ps.pos[i], ps.pos[j]);
+      }
+    });
+
+    ps.density[i] = density;
+    // PCISPH solves for pressure separately, from the previous step's.
+    if (opts.pressure_solver == PressureSolver::EquationOfState) {
+      ps.pressure[i] = opts.gas_constant * (density - opts.rest_density);
+    }
+  }
+
+  void _pressure_force_of(Particles &ps, const Neighbours &ns, FrameArena &arena, size_t i) {
+    Vec3 pressure_kernel_temp;
+    Vec3 pressure_temp{ 0, 0, 0 };
+    ArenaScope scope(arena);
+    NeighbourList neighbours = ns.neighbours_near(ps, ps.pos[i], arena);
+
+    for (size_t j = 0; j < neighbours.size(); j++) {
+      pressure_kernel_temp = kernel<SpikyGradKernel>(ps.pos[i], neighbours.pos[j]);
+      float pressure_factor = (ps.pressure[i] + neighbours.pressure[j]) / (2 * neighbours.density[j]);
+      pressure_kernel_temp *= pressure_factor;
+      pressure_temp += pressure_kernel_temp;
+    }
+    ps.force[i] = pressure_temp;
+#ifdef SPH_SPLIT_FORCES
+    ps.pforce[i] = pressure_temp;
+#endif
+  }
+
+  void _viscosity_force_of(Particles &ps, const Neighbours &ns, const SimOpts &opts, FrameArena &arena, size_t i) {
+    float viscosity_kernel_temp;
+    Vec3 viscosity_temp{ 0, 0, 0 };
+    ArenaScope scope(arena);
+    NeighbourList neighbours = ns.neighbours_near(ps, ps.pos[i], arena);
+
+    for (size_t j = 0; j < neighbours.size(); j++) {
+      viscosity_kernel_temp = kernel<ViscLaplKernel>(ps.pos[i], neighbours.pos[j]);
+      Vec3 viscosity_factor = (neighbours.vel[j] - ps.vel[i]);
+      viscosity_factor *= (1.0f / neighbours.density[j]);
+
+      viscosity_factor *= opts.viscosity_constant * viscosity_kernel_temp;
+      viscosity_temp += viscosity_factor;
+    }
+    ps.force[i] += viscosity_temp;
+#ifdef SPH_SPLIT_FORCES
+    ps.vforce[i] = viscosity_temp;
+#endif
+  }
+
+  void _density_pressure(Particles &ps, const Neighbours &ns, const SimOpts &opts, const CellBlock &block) {
+    if (opts.tiled_cells) {
+      _tiled_density_pressure(ps, ns, opts, block);
+      return;
+    }
+
+    for (size_t i = block.first_particle; i < block.last_particle; i++) {
+      _density_pressure_of(ps, ns, opts, i);
+    }
+  }
+
+  void _pressure_forces(Particles &ps, const Neighbours &ns, const SimOpts &opts, const CellBlock &block) {
+    if (opts.tiled_cells) {
+      _tiled_pressure_forces(ps, ns, block);
+      return;
+    }
+
+    FrameArena &arena = frame_arena();
+    for (size_t i = block.first_particle; i < block.last_particle; i++) {
+      _pressure_force_of(ps, ns, arena, i);
+    }
+  }
+
+  void _viscosity_forces(Particles &ps, const Neighbours &ns, const SimOpts &opts, const CellBlock &block) {
+    if (opts.tiled_cells) {
+      _tiled_viscosity_forces(ps, ns, opts, block);
+      return;
+    }
+
+    FrameArena &arena = frame_arena();
+    for (size_t i = block.first_particle; i < block.last_particle; i++) {
+      _viscosity_force_of(ps, ns, opts, arena, i);
+    }
+  }
+
+  void calculate_density_pressure(Particles &ps, Neighbours &ns, const SimOpts &opts) {
+    std::span<const CellBlock> blocks = ns.cell_blocks();
+
+    exec::for_each_block(opts.backend, ns.cell_block_costs(), [&](size_t b) {
+      _density_pressure(ps, ns, opts, blocks[b]);
+    });
+  }
+
   void calculate_pressure_forces(Particles &ps, Neighbours &ns, const SimOpts &opts) {
     // FIXME: Something is wrong with the calculation.
     //        Particles tend to get 'sucked' into each other.
     //        Try smaller timesteps ?
-    static Particles neighbours;
-    static uint32_t grid_width = std::floorf(2.0f / opts.support);
-    size_t particle_count = ps.size();
+    std::span<const CellBlock> blocks = ns.cell_blocks();
 
-    Vec3 pressure_kernel_temp;
-    for (size_t i = 0; i < particle_count; i++) {
-      Vec3 pressure_temp{ 0, 0, 0 };
-      ns.neighbours_near(ps, ps.pos[i], opts, neighbours);
+    exec::for_each_block(opts.backend, ns.cell_block_costs(), [&](size_t b) {
+      _pressure_forces(ps, ns, opts, blocks[b]);
+    });
+  }
+
+  void calculate_viscosity_forces(Particles &ps, Neighbours &ns, const SimOpts &opts) {
+    std::span<const CellBlock> blocks = ns.cell_blocks();
+
+    exec::for_each_block(opts.backend, ns.cell_block_costs(), [&](size_t b) {
+      _viscosity_forces(ps, ns, opts, blocks[b]);
+    });
+  }
+
+  void calculate_density_pressure(Particles &ps, Neighbours &ns, const SimOpts &opts, std::span<const uint32_t> due) {
+    exec::for_each_index(opts.backend, due.size(), [&](size_t k) {
+      _density_pressure_of(ps, ns, opts, due[k]);
+    });
+  }
 
-      for (size_t j = 0; j < neighbours.size(); j++) {
-        pressure_kernel_temp = kernel<SpikyGradKernel>(ps.pos[i], neighbours.pos[j]);
-        float pressure_factor = (ps.pressure[i] + neighbours.pressure[j]) / (2 * neighbours.density[j]);
-        pressure_kernel_temp *= pressure_factor;
-        pressure_temp += pressure_kernel_temp;
+  // Call `body(i, arena)` for every particle `i` of `due`, in equal runs
+  // through `exec::for_each_block`, since the force helpers gather their
+  // neighbours into the frame arena (which `for_each_index` must not use).
+  template<typename F>
+  void _for_each_due(const SimOpts &opts, std::span<const uint32_t> due, F &&body) {
+    if (due.empty()) {
+      return;
+    }
+
+    FrameArena &arena = frame_arena();
+    ArenaScope scope(arena);
+    size_t runs = std::min(due.size(), task_pool().size() * BLOCKS_PER_WORKER);
+    std::span<uint64_t> costs = arena.alloc<uint64_t>(runs);
+    std::fill(costs.begin(), costs.end(), 1);
+
+    exec::for_each_block(opts.backend, costs, [&](size_t run) {
+      FrameArena &run_arena = frame_arena();
+      size_t end = ((run + 1) * due.size()) / runs;
+      for (size_t k = (run * due.size()) / runs; k < end; k++) {
+        body(due[k], run_arena);
       }
-      ps.pforce[i] = pressure_temp;
+    });
+  }
+
+  void calculate_pressure_forces(Particles &ps, Neighbours &ns, const SimOpts &opts, std::span<const uint32_t> due) {
+    _for_each_due(opts, due, [&](size_t i, FrameArena &arena) {
+      _pressure_force_of(ps, ns, arena, i);
+    });
+  }
+
+  void calculate_viscosity_forces(Particles &ps, Neighbours &ns, const SimOpts &opts, std::span<const uint32_t> due) {
+    _for_each_due(opts, due, [&](size_t i, FrameArena &arena) {
+      _viscosity_force_of(ps, ns, opts, arena, i);
+    });
+  }
+
+  // Returns the acceleration applied.
+  Vec3 _kick(Particles &ps, size_t i, float dt, const SimOpts &opts) {
+    // NOTE: The external force is recomputed here rather than stored.
+    Vec3 external = external_force(ps.pos[i], opts.fountain_force);
+#ifdef SPH_SPLIT_FORCES
+    ps.eforce[i] = external;
+#endif
+
+    // F = ma <=> a = F/m, m = 1.0 => a = F
+    Vec3 acceleration = ps.force[i] + external;
+
+    // v = a * dt;
+    ps.vel[i] += acceleration * dt;
+    return acceleration;
+  }
+
+  void _drift(Particles &ps, size_t i, float dt) {
+    // d = v * dt;
+    ps.pos[i] += ps.vel[i] * dt;
+
+    // Boundary conditions.
+    if (ps.pos[i].x() < LEFT_BOUND || ps.pos[i].x() > RIGHT_BOUND) {
+      ps.pos[i].x(std::clamp<float>(ps.pos[i].x(), LEFT_BOUND, RIGHT_BOUND));
+      ps.vel[i].x(ps.vel[i].x() * -0.5);
+    }
+    if (ps.pos[i].y() < LOWER_BOUND || ps.pos[i].y() > UPPER_BOUND) {
+      ps.pos[i].y(std::clamp<float>(ps.pos[i].y(), LOWER_BOUND, UPPER_BOUND));
+      ps.vel[i].y(ps.vel[i].y() * -0.5);
+    }
+    if (ps.pos[i].z() < BACKWARD_BOUND || ps.pos[i].z() > FORWARD_BOUND) {
+      ps.pos[i].z(std::clamp<float>(ps.pos[i].z(), BACKWARD_BOUND, FORWARD_BOUND));
+      ps.vel[i].z(ps.vel[i].z() * -0.5);
     }
   }
 
-  void calculate_viscosity_forces(Particles &ps, Neighbours &ns, const SimOpts &opts) {
-    static Particles neighbours;
-    static uint32_t grid_width = std::floorf(2.0f / opts.support);
-    size_t particle_count = ps.size();
-    
-    float viscosity_kernel_temp;
-    for (size_t i = 0; i < particle_count; i++) {
-      Vec3 viscosity_temp{ 0, 0, 0 };
-      ns.neighbours_near(ps, ps.pos[i], opts, neighbours);
+  void _integrate(Particles &ps, size_t i, float dt, const SimOpts &opts) {
+    _kick(ps, i, dt, opts);
+    _drift(ps, i, dt);
+  }
+
+  uint8_t time_level(Vec3 vel, Vec3 acceleration, const SimOpts &opts) {
+    float dt = opts.time_step;
+    float speed = vel.length();
+    float accel = acceleration.length();
+    if (speed > 0) {
+      dt = std::min(dt, CFL_FACTOR * opts.support / speed);
+    }
+    if (accel > 0) {
+      dt = std::min(dt, CFL_FACTOR * std::sqrt(opts.support / accel));
+    }
+
+    uint32_t level = 0;
+    while (level + 1 < opts.time_levels && (opts.time_step / (1u << level)) > dt) {
+      level += 1;
+    }
+    return level;
+  }
+
+  void integrate(Particles &ps, const SimOpts &opts) {
+    exec::for_each_index(opts.backend, ps.size(), [&](size_t i) {
+      _integrate(ps, i, opts.time_step, opts);
+    });
+  }
+
+  void integrate(Particles &ps, Neighbours &ns, const SimOpts &opts, std::span<const uint32_t> due, uint32_t due_level) {
+    std::span<const CellBlock> blocks = ns.cell_blocks();
+    float sub_step = opts.time_step / (1u << (opts.time_levels - 1));
+
+    exec::for_each_index(opts.backend, due.size(), [&](size_t k) {
+      uint32_t i = due[k];
+      Vec3 acceleration = _kick(ps, i, opts.time_step / (1u << ps.level[i]), opts);
 
-      for (size_t j = 0; j < neighbours.size(); j++) {
-        viscosity_kernel_temp = kernel<ViscLaplKernel>(ps.pos[i], neighbours.pos[j]);
-        Vec3 viscosity_factor = (neighbours.vel[j] - ps.vel[i]);
-        viscosity_factor *= (1.0f / neighbours.density[j]);
+      // A particle can always move to a finer level, but only to a coarser
+      // one whose steps line up with this sub-step.
+      ps.level[i] = std::max<uint32_t>(time_level(ps.vel[i], acceleration, opts), due_level);
+    });
 
-        viscosity_factor *= opts.viscosity_constant * viscosity_kernel_temp;
-        viscosity_temp += viscosity_factor;
+    exec::for_each_block(opts.backend, ns.cell_block_costs(), [&](size_t b) {
+      for (size_t i = blocks[b].first_particle; i < blocks[b].last_particle; i++) {
+        _drift(ps, i, sub_step);
+      }
+    });
+  }
+
+  // With sleeping cells, only particles in the blocks (awake cells) move.
+  void _move_awake(Particles &ps, Neighbours &ns, const SimOpts &opts) {
+    std::span<const CellBlock> blocks = ns.cell_blocks();
+
+    exec::for_each_block(opts.backend, ns.cell_block_costs(), [&](size_t b) {
+      for (size_t i = blocks[b].first_particle; i < blocks[b].last_particle; i++) {
+        _integrate(ps, i, opts.time_step, opts);
+      }
+    });
+  }
+
+  /*** PCISPH ***/
+  float _dot(Vec3 a, Vec3 b) {
+    return (a.x() * b.x()) + (a.y() * b.y()) + (a.z() * b.z());
+  }
+
+  // Call `visit(origin, point)` for every point of a cubic lattice with the
+  // given spacing that lies within the support of the origin.
+  template<typename F>
+  void _for_each_lattice_point(float spacing, F &&visit) {
+    int32_t reach = std::ceil(SUPPORT / spacing);
+    Vec3 origin{ 0, 0, 0 };
+
+    for (int32_t z = -reach; z <= reach; z++) {
+      for (int32_t y = -reach; y <= reach; y++) {
+        for (int32_t x = -reach; x <= reach; x++) {
+          Vec3 point{ x * spacing, y * spacing, z * spacing };
+          visit(origin, point);
+        }
       }
-      ps.vforce[i] = viscosity_temp;
     }
   }
 
-  void calculate_external_forces(Particles &ps) {
-    size_t particle_count = ps.size();
+  // NOTE: For a particle with a full neighbourhood at rest density, a
+  //       pressure p applied over a step dt changes its density by
+  //       -p * dt^2 * beta / rest_density, where beta sums products of the
+  //       density and pressure kernel gradients over the neighbourhood
+  //       (Solenthaler and Pajarola 2009). The neighbourhood is a cubic
+  //       lattice spaced to give the rest density.
+  float _pcisph_beta(float rest_density) {
+    thread_local float cached_density = -1.0f;
+    thread_local float cached_beta = 0.0f;
+    if (rest_density == cached_density) {
+      return cached_beta;
+    }
 
-    for (size_t i = 0; i < particle_count; i++) {
-      /*
-      ps.eforce[i] = ps.pos[i].normalized();
-      ps.eforce[i].negate();
-      ps.eforce[i] *= GRAVITY_STRENGTH;
-      */
-      bool flow_up = ps.pos[i].y() < 0
-                   && std::abs(ps.pos[i].x()) < FOUNTAIN_WIDTH
-                   && std::abs(ps.pos[i].z()) < FOUNTAIN_WIDTH;
-      ps.eforce[i] = Vec3{ 0, -GRAVITY_STRENGTH, 0 };
-      if (flow_up) {
-        ps.eforce[i] = Vec3{ 0, GRAVITY_STRENGTH * FOUNTAIN_STRENGTH, 0 };
+    // Density falls as the lattice spreads out.
+    float low = 0.05f * SUPPORT;
+    float high = SUPPORT;
+    for (int i = 0; i < 32; i++) {
+      float spacing = 0.5f * (low + high);
+      float density = 0;
+      _for_each_lattice_point(spacing, [&](Vec3 &origin, Vec3 &point) {
+        density += kernel<PolyKernel>(origin, point);
+      });
+      if (density > rest_density) {
+        low = spacing;
+      } else {
+        high = spacing;
       }
     }
+
+    Vec3 poly_sum{ 0, 0, 0 };
+    Vec3 spiky_sum{ 0, 0, 0 };
+    float product_sum = 0;
+    _for_each_lattice_point(0.5f * (low + high), [&](Vec3 &origin, Vec3 &point) {
+      Vec3 poly = kernel<PolyGradKernel>(origin, point);
+      Vec3 spiky = kernel<SpikyGradKernel>(origin, point);
+      poly_sum += poly;
+      spiky_sum += spiky;
+      product_sum += _dot(poly, spiky);
+    });
+
+    cached_density = rest_density;
+    cached_beta = _dot(poly_sum, spiky_sum) + product_sum;
+    return cached_beta;
   }
 
-  void integrate(Particles &ps) {
-    size_t particle_count = ps.size();
+  Vec3 _clamp_to_bounds(Vec3 pos) {
+    return Vec3{
+      std::clamp<float>(pos.x(), LEFT_BOUND, RIGHT_BOUND),
+      std::clamp<float>(pos.y(), LOWER_BOUND, UPPER_BOUND),
+      std::clamp<float>(pos.z(), BACKWARD_BOUND, FORWARD_BOUND),
+    };
+  }
 
-    Vec3 acceleration;
-    for (size_t i = 0; i < particle_count; i++) {
-      // F = ma <=> a = F/m, m = 1.0 => a = F
-      acceleration = ps.pforce[i] + ps.vforce[i] + ps.eforce[i];
+  // Neighbours within the support of every solved particle, found once per
+  // step and reused by each correction, with the pair terms that only
+  // depend on the step's positions, velocities and densities.
+  struct _PairList {
+    std::span<uint32_t> starts; // per particle, plus one past the last
+    std::span<uint32_t> neighbours;
+    std::span<Vec3> gradients;  // SpikyGradKernel / (2 * density[j])
+  };
 
-      // v = a * dt;
-      ps.vel[i] += acceleration * (1.0f / 60); // FIXME: actually use delta time.
+  template<typename F>
+  void _for_each_pair(const Particles &ps, const Neighbours &ns, size_t i, F &&visit) {
+    ns.for_each_neighbour_cell(ps.pos[i], [&](uint32_t start_idx, uint32_t end_idx) {
+      for (uint32_t j = start_idx; j < end_idx; j++) {
+        if ((ps.pos[j] - ps.pos[i]).length_squared() < SUPPORT * SUPPORT) {
+          visit(j);
+        }
+      }
+    });
+  }
 
-      // d = v * dt;
-      ps.pos[i] += ps.vel[i] * (1.0f / 60);
+  // List the pairs of every solved particle, and sum its viscosity force
+  // into `viscous` on the way, since that also only needs one pass.
+  _PairList _build_pairs(Particles &ps, const Neighbours &ns, const SimOpts &opts, FrameArena &arena, std::span<Vec3> viscous) {
+    std::span<const CellBlock> blocks = ns.cell_blocks();
+    std::span<const uint64_t> costs = ns.cell_block_costs();
+    _PairList pairs;
+    pairs.starts = arena.alloc<uint32_t>(ps.size() + 1);
 
-      // Boundary conditions.
-      if (ps.pos[i].x() < LEFT_BOUND || ps.pos[i].x() > RIGHT_BOUND) {
-        ps.pos[i].x(std::clamp<float>(ps.pos[i].x(), LEFT_BOUND, RIGHT_BOUND));
-        ps.vel[i].x(ps.vel[i].x() * -0.5);
+    // Particles outside the blocks (asleep) get no pairs.
+    exec::for_each_index(opts.backend, ps.size() + 1, [&](size_t i) {
+      pairs.starts[i] = 0;
+    });
+    exec::for_each_block(opts.backend, costs, [&](size_t b) {
+      for (size_t i = blocks[b].first_particle; i < blocks[b].last_particle; i++) {
+        uint32_t count = 0;
+        _for_each_pair(ps, ns, i, [&](uint32_t) { count += 1; });
+        pairs.starts[i + 1] = count;
       }
-      if (ps.pos[i].y() < LOWER_BOUND || ps.pos[i].y() > UPPER_BOUND) {
-        ps.pos[i].y(std::clamp<float>(ps.pos[i].y(), LOWER_BOUND, UPPER_BOUND));
-        ps.vel[i].y(ps.vel[i].y() * -0.5);
+    });
+    for (size_t i = 1; i < pairs.starts.size(); i++) {
+      pairs.starts[i] += pairs.starts[i - 1];
+    }
+
+    pairs.neighbours = arena.alloc<uint32_t>(pairs.starts.back());
+    pairs.gradients = arena.alloc<Vec3>(pairs.starts.back());
+    exec::for_each_block(opts.backend, costs, [&](size_t b) {
+      for (size_t i = blocks[b].first_particle; i < blocks[b].last_particle; i++) {
+        uint32_t k = pairs.starts[i];
+        Vec3 viscosity{ 0, 0, 0 };
+        _for_each_pair(ps, ns, i, [&](uint32_t j) {
+          Vec3 gradient = kernel<SpikyGradKernel>(ps.pos[i], ps.pos[j]);
+          gradient *= 1.0f / (2 * ps.density[j]);
+          pairs.neighbours[k] = j;
+          pairs.gradients[k] = gradient;
+          k += 1;
+
+          Vec3 viscosity_factor = ps.vel[j] - ps.vel[i];
+          viscosity_factor *= opts.viscosity_constant * kernel<ViscLaplKernel>(ps.pos[i], ps.pos[j]) * (1.0f / ps.density[j]);
+          viscosity += viscosity_factor;
+        });
+        viscous[i] = viscosity;
       }
-      if (ps.pos[i].z() < BACKWARD_BOUND || ps.pos[i].z() > FORWARD_BOUND) {
-        ps.pos[i].z(std::clamp<float>(ps.pos[i].z(), BACKWARD_BOUND, FORWARD_BOUND));
-        ps.vel[i].z(ps.vel[i].z() * -0.5);
+    });
+
+    return pairs;
+  }
+
+  Vec3 _pair_pressure_force(const Particles &ps, const _PairList &pairs, size_t i) {
+    Vec3 force{ 0, 0, 0 };
+    for (uint32_t k = pairs.starts[i]; k < pairs.starts[i + 1]; k++) {
+      Vec3 term = pairs.gradients[k];
+      term *= ps.pressure[i] + ps.pressure[pairs.neighbours[k]];
+      force += term;
+    }
+    return force;
+  }
+
+  uint32_t calculate_pcisph_pressure(Particles &ps, Neighbours &ns, const SimOpts &opts) {
+    std::span<const CellBlock> blocks = ns.cell_blocks();
+    std::span<const uint64_t> costs = ns.cell_block_costs();
+    float dt = opts.time_step;
+    float delta = opts.rest_density / (dt * dt * _pcisph_beta(opts.rest_density));
+    // NOTE: A box too small to hold the fluid at rest density can never
+    //       reach it, and pressures would grow without bound. Such fluid
+    //       aims for filling the box instead.
+    float box_volume = (RIGHT_BOUND - LEFT_BOUND) * (UPPER_BOUND - LOWER_BOUND) * (FORWARD_BOUND - BACKWARD_BOUND);
+    float target = std::max(opts.rest_density, ps.size() / box_volume);
+
+    FrameArena &arena = frame_arena();
+    ArenaScope scope(arena);
+    std::span<Vec3> predicted = arena.alloc<Vec3>(ps.size());
+    std::span<Vec3> viscous = arena.alloc<Vec3>(ps.size());
+    std::span<double> block_compression = arena.alloc<double>(blocks.size());
+    _PairList pairs = _build_pairs(ps, ns, opts, arena, viscous);
+
+    // Particles outside the blocks (asleep) stay where they are.
+    size_t solved = 0;
+    for (const CellBlock &block : blocks) {
+      solved += block.last_particle - block.first_particle;
+    }
+    exec::for_each_index(opts.backend, ps.size(), [&](size_t i) {
+      predicted[i] = ps.pos[i];
+    });
+    exec::for_each_block(opts.backend, costs, [&](size_t b) {
+      for (size_t i = blocks[b].first_particle; i < blocks[b].last_particle; i++) {
+        ps.pressure[i] *= PCISPH_WARM_START;
       }
+    });
+
+    uint32_t iteration = 0;
+    while (true) {
+      exec::for_each_block(opts.backend, costs, [&](size_t b) {
+        for (size_t i = blocks[b].first_particle; i < blocks[b].last_particle; i++) {
+          Vec3 acceleration = _pair_pressure_force(ps, pairs, i) + viscous[i] + external_force(ps.pos[i], opts.fountain_force);
+          Vec3 vel = ps.vel[i] + (acceleration * dt);
+          predicted[i] = _clamp_to_bounds(ps.pos[i] + (vel * dt));
+        }
+      });
+
+      // NOTE: Only compression is corrected, and pressures never go negative,
+      //       so sparse particles (the free surface) are not pulled together.
+      exec::for_each_block(opts.backend, costs, [&](size_t b) {
+        double compression_sum = 0;
+        for (size_t i = blocks[b].first_particle; i < blocks[b].last_particle; i++) {
+          float density = 0;
+          for (uint32_t k = pairs.starts[i]; k < pairs.starts[i + 1]; k++) {
+            density += kernel<PolyKernel>(predicted[i], predicted[pairs.neighbours[k]]);
+          }
+
+          float compression = density - target;
+          ps.pressure[i] = std::max(ps.pressure[i] + (delta * compression), 0.0f);
+          compression_sum += std::max(compression, 0.0f);
+        }
+        block_compression[b] = compression_sum;
+      });
+      iteration += 1;
+
+      double compression = 0;
+      for (double block_sum : block_compression) {
+        compression += block_sum;
+      }
+      bool converged = compression <= opts.pcisph_tolerance * target * solved;
+      if (converged || iteration >= opts.pcisph_max_iterations) {
+        break;
+      }
+    }
+
+    exec::for_each_block(opts.backend, costs, [&](size_t b) {
+      for (size_t i = blocks[b].first_particle; i < blocks[b].last_particle; i++) {
+        Vec3 pressure = _pair_pressure_force(ps, pairs, i);
+        ps.force[i] = pressure + viscous[i];
+#ifdef SPH_SPLIT_FORCES
+        ps.pforce[i] = pressure;
+        ps.vforce[i] = viscous[i];
+#endif
+      }
+    });
+    return iteration;
+  }
+
+  // Each block gets three tasks: density, forces and integration. Forces
+  // wait for the densities of the nearby blocks and integration for their
+  // forces, since those read this block's positions and velocities.
+  void _step_graph(Particles &ps, Neighbours &ns, const SimOpts &opts) {
+    thread_local TaskGraph graph;
+    std::span<const CellBlock> blocks = ns.cell_blocks();
+    uint32_t block_count = blocks.size();
+
+    graph.reset(3 * block_count);
+    for (uint32_t stage = 0; stage < 2; stage++) {
+      for (uint32_t b = 0; b < block_count; b++) {
+        for (uint32_t near = blocks[b].first_near_block; near < blocks[b].last_near_block; near++) {
+          graph.add_edge((stage * block_count) + b, ((stage + 1) * block_count) + near);
+        }
+      }
+    }
+
+    task_pool().run_graph(graph, [&](size_t task) {
+      const CellBlock &block = blocks[task % block_count];
+
+      switch (task / block_count) {
+        case 0:
+          _density_pressure(ps, ns, opts, block);
+          break;
+        case 1:
+          _pressure_forces(ps, ns, opts, block);
+          _viscosity_forces(ps, ns, opts, block);
+          break;
+        case 2:
+          for (size_t i = block.first_particle; i < block.last_particle; i++) {
+            _integrate(ps, i, opts.time_step, opts);
+          }
+          break;
+      }
+    });
+  }
+
+  // The particles of the cell blocks by time step level, finest first, so
+  // that those due at any sub-step come first: `order[0, due_counts[l])` are
+  // the particles at level l and above.
+  struct LevelLists {
+    ParticleArray<uint32_t> order;
+    ParticleArray<uint32_t> scratch;
+    std::array<uint32_t, MAX_TIME_LEVELS + 1> due_counts;
+  };
+
+  // Counting sort of `lists.order[0, count)`, whose particles are all at
+  // `first_level` or above, by level. Sets the due counts from `first_level`
+  // up; those below it are unchanged.
+  void _sort_levels(const Particles &ps, LevelLists &lists, uint32_t count, uint32_t first_level, uint32_t time_levels) {
+    std::array<uint32_t, MAX_TIME_LEVELS + 1> counts{};
+    for (uint32_t k = 0; k < count; k++) {
+      counts[ps.level[lists.order[k]]] += 1;
+    }
+
+    std::array<uint32_t, MAX_TIME_LEVELS> next{};
+    lists.due_counts[time_levels] = 0;
+    for (uint32_t level = time_levels; level-- > first_level;) {
+      next[level] = lists.due_counts[level + 1];
+      lists.due_counts[level] = next[level] + counts[level];
+    }
+
+    for (uint32_t k = 0; k < count; k++) {
+      uint32_t i = lists.order[k];
+      lists.scratch[next[ps.level[i]]++] = i;
+    }
+    std::copy(lists.scratch.begin(), lists.scratch.begin() + count, lists.order.begin());
+  }
+
+  // Rebuild the lists from the cell blocks, after a sort.
+  void _build_levels(const Particles &ps, const Neighbours &ns, LevelLists &lists, uint32_t time_levels) {
+    uint32_t count = 0;
+    lists.order.resize(ps.size());
+    lists.scratch.resize(ps.size());
+    for (const CellBlock &block : ns.cell_blocks()) {
+      for (uint32_t i = block.first_particle; i < block.last_particle; i++) {
+        lists.order[count++] = i;
+      }
+    }
+    _sort_levels(ps, lists, count, 0, time_levels);
+  }
+
+  // Multiple time stepping. Level l is due every 2^(time_levels - 1 - l)
+  // sub-steps, so at sub-step s the due particles are those at or above
+  // level (time_levels - 1 - trailing zeros of s), and all of them at s = 0.
+  // Only due particles are visited, through the level lists. Returns the
+  // time integrated since the last sort.
+  float _step_levels(Particles &ps, Neighbours &ns, const SimOpts &opts) {
+    thread_local LevelLists lists;
+    uint32_t finest = opts.time_levels - 1;
+    uint32_t sub_steps = 1u << finest;
+    float since_sort = 0;
+
+    for (uint32_t s = 0; s < sub_steps; s++) {
+      uint32_t due_level = (s == 0) ? 0 : finest - std::countr_zero(s);
+
+      // NOTE: Sub-steps where only the finest level is due keep the grid
+      //       (and particle order) of the one before. Particles have moved
+      //       by at most a sub-step since, within CFL_FACTOR of the support,
+      //       so only neighbours about a support apart can be missed, where
+      //       the kernels have nearly vanished.
+      if (due_level < finest) {
+        ns.process(ps, opts);
+        _build_levels(ps, ns, lists, opts.time_levels);
+        since_sort = 0;
+      }
+
+      std::span<const uint32_t> due(lists.order.data(), lists.due_counts[due_level]);
+      if (due_level == 0) {
+        calculate_density_pressure(ps, ns, opts);
+        calculate_pressure_forces(ps, ns, opts);
+        calculate_viscosity_forces(ps, ns, opts);
+      } else {
+        calculate_density_pressure(ps, ns, opts, due);
+        calculate_pressure_forces(ps, ns, opts, due);
+        calculate_viscosity_forces(ps, ns, opts, due);
+      }
+      integrate(ps, ns, opts, due, due_level);
+
+      // Due particles only move between the levels they span.
+      if (due_level < finest) {
+        _sort_levels(ps, lists, due.size(), due_level, opts.time_levels);
+      }
+      since_sort += opts.time_step / sub_steps;
+    }
+    return since_sort;
+  }
+
+  void step(Particles &ps, Neighbours &ns, const SimOpts &opts) {
+    bool pcisph = (opts.pressure_solver == PressureSolver::Pcisph);
+
+    float elapsed = opts.time_step;
+    if (opts.time_levels > 1 && !pcisph) {
+      elapsed = _step_levels(ps, ns, opts);
+    } else if (opts.task_graph && !pcisph) {
+      ns.process(ps, opts);
+      _step_graph(ps, ns, opts);
+    } else {
+      ns.process(ps, opts);
+      calculate_density_pressure(ps, ns, opts);
+      if (pcisph) {
+        calculate_pcisph_pressure(ps, ns, opts);
+      } else {
+        calculate_pressure_forces(ps, ns, opts);
+        calculate_viscosity_forces(ps, ns, opts);
+      }
+
+      if (opts.sleep_cells) {
+        _move_awake(ps, ns, opts);
+      } else {
+        integrate(ps, opts);
+      }
+    }
+
+    if (opts.sleep_cells) {
+      ns.update_activity(ps, elapsed);
     }
   }
 }
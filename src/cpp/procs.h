@@ -3,27 +3,87 @@
 #include "sim_opts.h"
 #include "particles.h"
 #include "neighbours.h"
+#include "util.h"
 #include <libcommon/vec.h>
+#include <numbers>
+#include <span>
 
 namespace particles {
   // Kernel Functions.
   struct PolyKernel      { using return_type = float; };
+  struct PolyGradKernel  { using return_type = Vec3; };
   struct SpikyGradKernel { using return_type = Vec3; };
   struct ViscLaplKernel  { using return_type = float; };
 
   template<typename T>
   concept Kernel = std::same_as<T, PolyKernel> ||
+                   std::same_as<T, PolyGradKernel> ||
                    std::same_as<T, SpikyGradKernel> ||
                    std::same_as<T, ViscLaplKernel>;
 
+  // Kernel coefficients, shared with the passes that inline the kernels:
+  // the tiled cell pairs and field sampling.
+  constexpr float POLY_COEFFICIENT = 315.0f / (64 * std::numbers::pi_v<float> * util::pow(SUPPORT, 9));
+  constexpr float SPIKY_GRAD_COEFFICIENT = -45.0f / (std::numbers::pi_v<float> * util::pow(SUPPORT, 6));
+  constexpr float VISC_LAPL_COEFFICIENT = 45.0f / (std::numbers::pi_v<float> * util::pow(SUPPORT, 6));
+
+  // Share of the previous step's pressures PCISPH starts from. Carrying all
+  // of them over lets pressures that corrections can not relieve (fluid
+  // pressed into a wall) build up from step to step.
+  constexpr float PCISPH_WARM_START = 0.5f;
+
+  // Particles per tile of the tiled cell pair passes (SimOpts::tiled_cells).
+  // A target and a neighbour tile of every field take 4 KiB, well within L1.
+  constexpr uint32_t TILE_SIZE = 64;
+
   template<typename T>
   requires Kernel<T>
   typename T::return_type kernel(Vec3 &pos, Vec3 &particle);
 
-  // Force Computation Functions.
+  // Force Computation Functions. The pressure pass sets `ps.force` and the
+  // viscosity pass adds to it, so they run in that order. Integration adds
+  // the external force itself.
   void calculate_density_pressure(Particles &ps, Neighbours &ns, const SimOpts &opts);
   void calculate_pressure_forces(Particles &ps, Neighbours &ns, const SimOpts &opts);
   void calculate_viscosity_forces(Particles &ps, Neighbours &ns, const SimOpts &opts);
-  void calculate_external_forces(Particles &ps);
-  void integrate(Particles &ps);
+  void integrate(Particles &ps, const SimOpts &opts);
+
+  // The same passes over only the (sorted) particle indexes in `due`, for
+  // the sub-steps of multiple time stepping.
+  void calculate_density_pressure(Particles &ps, Neighbours &ns, const SimOpts &opts, std::span<const uint32_t> due);
+  void calculate_pressure_forces(Particles &ps, Neighbours &ns, const SimOpts &opts, std::span<const uint32_t> due);
+  void calculate_viscosity_forces(Particles &ps, Neighbours &ns, const SimOpts &opts, std::span<const uint32_t> due);
+
+  /**
+   * PCISPH pressure solve, after the density pass, in place of the pressure
+   * and viscosity passes. Corrects `ps.pressure` (started from part of the
+   * previous step's) until the densities predicted for the end of the step
+   * are within tolerance, and leaves the matching pressure plus viscosity
+   * forces in `ps.force`. Neighbours within the support are listed once, so
+   * each correction walks its pairs instead of the grid stencil. Returns
+   * the number of corrections run.
+   */
+  uint32_t calculate_pcisph_pressure(Particles &ps, Neighbours &ns, const SimOpts &opts);
+
+  /**
+   * One sub-step of multiple time stepping. The particles in `due` get their
+   * external force and a velocity update over their own level's time step,
+   * then pick their next level, no coarser than `due_level`. Every particle
+   * of the cell blocks then moves by one sub-step.
+   */
+  void integrate(Particles &ps, Neighbours &ns, const SimOpts &opts, std::span<const uint32_t> due, uint32_t due_level);
+
+  /**
+   * Finest level, up to `opts.time_levels - 1`, whose time step keeps a
+   * particle within CFL_FACTOR of the support by its speed and acceleration.
+   */
+  uint8_t time_level(Vec3 vel, Vec3 acceleration, const SimOpts &opts);
+
+  /**
+   * Advance the simulation by one time step: sort into the neighbour grid,
+   * compute all forces, then integrate. With several time levels, the step
+   * is split into sub-steps that each do the same for the due particles,
+   * re-sorting only when a level coarser than the finest is due.
+   */
+  void step(Particles &ps, Neighbours &ns, const SimOpts &opts);
 }
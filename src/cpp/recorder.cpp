@@ -0,0 +1,160 @@
+#include "recorder.h"
+
+#include "particles.h"
+#include "sim_opts.h"
+#include "trajectory.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <format>
+#include <mutex>
+#include <stdexcept>
+#include <unistd.h>
+#include <vector>
+
+static bool _pwrite_all(int fd, const void *data, size_t size, uint64_t offset) {
+  const char *bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t written = pwrite(fd, bytes, size, offset);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    bytes += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
+
+Recorder::Recorder(const std::filesystem::path &path, uint32_t capacity, uint32_t fields, uint32_t interval)
+: fd{-1},
+  header{},
+  pool(RECORDER_POOL_SIZE),
+  frames_queued{0},
+  frames_dropped{0},
+  write_failed{false} {
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error(std::format("Failed to create trajectory file: {}", path.string()));
+  }
+
+  std::memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+  header.version = TRAJECTORY_VERSION;
+  header.capacity = capacity;
+  header.fields = fields;
+  header.interval = std::max(interval, 1u);
+  header.bounds_min = X_BOUNDS.x();
+  header.bounds_max = X_BOUNDS.y();
+  header.frame_size = trajectory::frame_size(capacity, fields);
+  header.frame_count = 0;
+
+  if (!_pwrite_all(fd, &header, sizeof(TrajectoryHeader), 0)) {
+    close(fd);
+    throw std::runtime_error(std::format("Failed to write trajectory file: {}", path.string()));
+  }
+
+  for (Snapshot &snapshot : pool) {
+    snapshot.pos.reserve(capacity);
+    snapshot.vel.reserve((fields & TRAJ_VELOCITY) ? capacity : 0);
+    snapshot.density.reserve((fields & TRAJ_DENSITY) ? capacity : 0);
+    free_snapshots.push_back(&snapshot);
+  }
+
+  writer = std::jthread([this](std::stop_token stop) { write_frames(stop); });
+}
+
+Recorder::~Recorder() {
+  // Pending frames are still written before the writer exits.
+  writer.request_stop();
+  wake.notify_all();
+  if (writer.joinable()) {
+    writer.join();
+  }
+
+  _pwrite_all(fd, &header, sizeof(TrajectoryHeader), 0);
+  close(fd);
+}
+
+void Recorder::record(const Particles &ps, uint64_t step) {
+  if (step % header.interval != 0) {
+    return;
+  }
+
+  Snapshot *snapshot = nullptr;
+  {
+    std::lock_guard guard(lock);
+    if (free_snapshots.empty() || write_failed) {
+      frames_dropped += 1;
+      return;
+    }
+    snapshot = free_snapshots.back();
+    free_snapshots.pop_back();
+  }
+
+  size_t count = std::min<size_t>(ps.size(), header.capacity);
+  snapshot->step = step;
+  snapshot->pos.assign(ps.pos.begin(), ps.pos.begin() + count);
+  if (header.fields & TRAJ_VELOCITY) {
+    snapshot->vel.assign(ps.vel.begin(), ps.vel.begin() + count);
+  }
+  if (header.fields & TRAJ_DENSITY) {
+    snapshot->density.assign(ps.density.begin(), ps.density.begin() + count);
+  }
+
+  {
+    std::lock_guard guard(lock);
+    snapshot->frame_index = frames_queued;
+    frames_queued += 1;
+    pending.push_back(snapshot);
+  }
+  wake.notify_one();
+}
+
+void Recorder::write_frames(std::stop_token stop) {
+  std::vector<std::byte> encoded(header.frame_size);
+
+  while (true) {
+    Snapshot *snapshot = nullptr;
+    {
+      std::unique_lock guard(lock);
+      wake.wait(guard, stop, [this] { return !pending.empty(); });
+      if (pending.empty()) {
+        // Only reached once a stop has been requested and all frames written.
+        return;
+      }
+      snapshot = pending.front();
+      pending.pop_front();
+    }
+
+    trajectory::encode_frame(header, snapshot->step, snapshot->pos, snapshot->vel, snapshot->density, encoded.data());
+    uint64_t offset = sizeof(TrajectoryHeader) + (snapshot->frame_index * header.frame_size);
+    bool written = _pwrite_all(fd, encoded.data(), encoded.size(), offset);
+
+    {
+      std::lock_guard guard(lock);
+      if (written) {
+        header.frame_count = std::max(header.frame_count, snapshot->frame_index + 1);
+      } else {
+        write_failed = true;
+      }
+      free_snapshots.push_back(snapshot);
+    }
+  }
+}
+
+uint64_t Recorder::dropped_frames() {
+  std::lock_guard guard(lock);
+  return frames_dropped;
+}
+
+bool Recorder::failed() {
+  std::lock_guard guard(lock);
+  return write_failed;
+}
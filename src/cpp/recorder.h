@@ -0,0 +1,65 @@
+#pragma once
+
+#include "particles.h"
+#include "trajectory.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <libcommon/vec.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+constexpr uint32_t RECORDER_POOL_SIZE = 8; // frames buffered ahead of the disk
+
+/**
+ * Records every `interval`-th step to a trajectory file without blocking the
+ * caller on disk writes. A snapshot is a plain copy into a pooled buffer; a
+ * background thread quantizes it and writes it with pwrite(). When every
+ * buffer is still waiting on the disk the frame is dropped and counted.
+ */
+class Recorder {
+  struct Snapshot {
+    uint64_t step;
+    uint64_t frame_index;
+    std::vector<Vec3> pos;
+    std::vector<Vec3> vel;
+    std::vector<float> density;
+  };
+
+  int fd;
+  TrajectoryHeader header;
+  std::vector<Snapshot> pool;
+  std::vector<Snapshot*> free_snapshots;
+  std::deque<Snapshot*> pending;
+  std::mutex lock;
+  std::condition_variable_any wake;
+  uint64_t frames_queued;
+  uint64_t frames_dropped;
+  bool write_failed;
+  std::jthread writer;
+
+  void write_frames(std::stop_token stop);
+
+  public:
+    /**
+     * Create (or truncate) the trajectory file at `path`.
+     *
+     * @throws std::runtime_error if the file can not be created.
+     */
+    Recorder(const std::filesystem::path &path, uint32_t capacity, uint32_t fields, uint32_t interval);
+    ~Recorder();
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    /**
+     * Snapshot `ps` if `step` falls on the recording interval.
+     */
+    void record(const Particles &ps, uint64_t step);
+
+    uint64_t dropped_frames();
+    bool failed();
+};
@@ -0,0 +1,175 @@
+#include "shared_frames.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <libcommon/vec.h>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+uint64_t _slot_size(uint32_t capacity) {
+  uint64_t size = sizeof(SharedFrameSlot) + (static_cast<uint64_t>(capacity) * sizeof(Vec3));
+  // Keep every slot header on its own cache line.
+  return ((size + alignof(SharedFrameSlot) - 1) / alignof(SharedFrameSlot)) * alignof(SharedFrameSlot);
+}
+
+size_t _slots_offset() {
+  return ((sizeof(SharedFramesHeader) + alignof(SharedFrameSlot) - 1) / alignof(SharedFrameSlot)) * alignof(SharedFrameSlot);
+}
+
+FramePublisher::FramePublisher(const std::string &name, uint32_t capacity, float particle_radius, bool replace)
+: name{name},
+  mapping{nullptr},
+  mapping_size{0},
+  header{nullptr},
+  frame{0} {
+  uint64_t slot_size = _slot_size(capacity);
+  size_t size = _slots_offset() + (SHARED_FRAME_SLOTS * slot_size);
+
+  // Always start from a fresh object so readers of an earlier run never see
+  // it change size under them, and never take over another live ring.
+  if (replace) {
+    shm_unlink(name.c_str());
+  }
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0 && errno == EEXIST) {
+    throw std::runtime_error(std::format("Shared memory already exists: {}", name));
+  }
+  if (fd < 0) {
+    throw std::runtime_error(std::format("Failed to create shared memory: {}", name));
+  }
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    shm_unlink(name.c_str());
+    throw std::runtime_error(std::format("Failed to size shared memory: {}", name));
+  }
+
+  void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    throw std::runtime_error(std::format("Failed to map shared memory: {}", name));
+  }
+  mapping = static_cast<std::byte*>(map);
+  mapping_size = size;
+
+  // The object starts zeroed: every slot sequence and `latest` are 0.
+  header = new (mapping) SharedFramesHeader{};
+  std::memcpy(header->magic, SHARED_FRAMES_MAGIC, sizeof(SHARED_FRAMES_MAGIC));
+  header->version = SHARED_FRAMES_VERSION;
+  header->capacity = capacity;
+  header->slot_count = SHARED_FRAME_SLOTS;
+  header->particle_radius = particle_radius;
+  header->slot_size = slot_size;
+  for (uint32_t s = 0; s < SHARED_FRAME_SLOTS; s++) {
+    new (mapping + _slots_offset() + (s * slot_size)) SharedFrameSlot{};
+  }
+  header->latest.store(0, std::memory_order_release);
+}
+
+FramePublisher::~FramePublisher() {
+  if (mapping) {
+    munmap(mapping, mapping_size);
+    shm_unlink(name.c_str());
+  }
+}
+
+void FramePublisher::publish(std::span<const Vec3> pos, uint64_t step) {
+  frame += 1;
+  SharedFrameSlot *slot = reinterpret_cast<SharedFrameSlot*>(
+    mapping + _slots_offset() + ((frame % header->slot_count) * header->slot_size)
+  );
+  uint32_t count = static_cast<uint32_t>(std::min<size_t>(pos.size(), header->capacity));
+
+  // Mark the slot as being written before touching its contents.
+  slot->sequence.store((2 * frame) - 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->step = step;
+  slot->particle_count = count;
+  std::memcpy(reinterpret_cast<Vec3*>(slot + 1), pos.data(), count * sizeof(Vec3));
+
+  slot->sequence.store(2 * frame, std::memory_order_release);
+  header->latest.store(frame, std::memory_order_release);
+}
+
+FrameSubscriber::FrameSubscriber(const std::string &name)
+: mapping{nullptr},
+  mapping_size{0},
+  header{nullptr} {
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    throw std::runtime_error(std::format("No shared memory named: {}", name));
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < _slots_offset()) {
+    close(fd);
+    throw std::runtime_error(std::format("Not a shared frame ring: {}", name));
+  }
+
+  void *map = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error(std::format("Failed to map shared memory: {}", name));
+  }
+  mapping = static_cast<std::byte*>(map);
+  mapping_size = static_cast<size_t>(info.st_size);
+  header = reinterpret_cast<const SharedFramesHeader*>(mapping);
+
+  if (std::memcmp(header->magic, SHARED_FRAMES_MAGIC, sizeof(SHARED_FRAMES_MAGIC)) != 0
+      || header->version != SHARED_FRAMES_VERSION
+      || header->slot_count == 0
+      || header->slot_size != _slot_size(header->capacity)
+      || mapping_size < _slots_offset() + (header->slot_count * header->slot_size)) {
+    munmap(mapping, mapping_size);
+    throw std::runtime_error(std::format("Not a shared frame ring: {}", name));
+  }
+}
+
+FrameSubscriber::~FrameSubscriber() {
+  if (mapping) {
+    munmap(mapping, mapping_size);
+  }
+}
+
+uint32_t FrameSubscriber::capacity() const {
+  return header->capacity;
+}
+
+float FrameSubscriber::particle_radius() const {
+  return header->particle_radius;
+}
+
+uint64_t FrameSubscriber::latest() const {
+  return header->latest.load(std::memory_order_acquire);
+}
+
+const SharedFrameSlot *FrameSubscriber::slot(uint64_t frame) const {
+  return reinterpret_cast<const SharedFrameSlot*>(
+    mapping + _slots_offset() + ((frame % header->slot_count) * header->slot_size)
+  );
+}
+
+bool FrameSubscriber::slot_holds(const SharedFrameSlot *slot, uint64_t frame) const {
+  // Acquire pairs with the writer's release once the frame is complete, so
+  // the contents read next are at least that frame's.
+  return slot->sequence.load(std::memory_order_acquire) == 2 * frame;
+}
+
+bool FrameSubscriber::still_holds(const SharedFrameSlot *slot, uint64_t frame) const {
+  // Any write to the slot that the copy may have seen made the sequence odd
+  // first; the fence orders the copy before this second look.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot->sequence.load(std::memory_order_relaxed) == 2 * frame;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <libcommon/vec.h>
+#include <span>
+#include <string>
+
+constexpr uint32_t SHARED_FRAMES_VERSION = 1;
+constexpr char SHARED_FRAMES_MAGIC[8] = { 'S', 'P', 'H', 'S', 'H', 'M', '\0', '\0' };
+constexpr uint32_t SHARED_FRAME_SLOTS = 4;
+constexpr uint32_t SHARED_READ_RETRIES = 16;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared frame counters must be lock free");
+
+// A shared frame ring is a SharedFramesHeader followed by `slot_count` slots
+// of exactly `slot_size` bytes. Each slot is a SharedFrameSlot followed by
+//   Vec3 pos[capacity]
+// of which only the first `particle_count` entries are meaningful.
+//
+// Frames are numbered from 1 and frame g lives in slot g % slot_count. A slot
+// is a seqlock: its `sequence` is 2g - 1 while frame g is being written and
+// 2g once it is complete. `latest` is the newest complete frame, 0 before the
+// first.
+struct SharedFramesHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t capacity;
+  uint32_t slot_count;
+  float particle_radius;
+  uint64_t slot_size;
+  std::atomic<uint64_t> latest;
+};
+
+struct alignas(64) SharedFrameSlot {
+  std::atomic<uint64_t> sequence;
+  uint64_t step;
+  uint32_t particle_count;
+};
+
+/**
+ * Publishes particle positions to a POSIX shared memory ring that any number
+ * of other processes may read (see FrameSubscriber). Publishing is one copy
+ * into the next slot and never waits on readers; a reader that is still
+ * copying a slot when the writer comes back around to it notices and retries.
+ */
+class FramePublisher {
+  std::string name;
+  std::byte *mapping;
+  size_t mapping_size;
+  SharedFramesHeader *header;
+  uint64_t frame;
+
+  public:
+    /**
+     * Create the shared memory object `name` (e.g. "/sph"), sized for up to
+     * `capacity` particles. An existing object of that name is unlinked first
+     * only with `replace`, e.g. one left behind by a run that crashed.
+     *
+     * @throws std::runtime_error if the object already exists (without
+     *         `replace`) or can not be created or mapped.
+     */
+    FramePublisher(const std::string &name, uint32_t capacity, float particle_radius, bool replace = false);
+
+    /**
+     * Unlinks the object. Attached readers keep their mapping and the last
+     * frame.
+     */
+    ~FramePublisher();
+
+    FramePublisher(const FramePublisher&) = delete;
+    FramePublisher& operator=(const FramePublisher&) = delete;
+
+    /**
+     * Publish the first `min(pos.size(), capacity)` positions as the frame
+     * of `step`.
+     */
+    void publish(std::span<const Vec3> pos, uint64_t step);
+};
+
+/**
+ * Reads the newest frame of a ring created by a FramePublisher, possibly in
+ * another process.
+ */
+class FrameSubscriber {
+  std::byte *mapping;
+  size_t mapping_size;
+  const SharedFramesHeader *header;
+
+  const SharedFrameSlot *slot(uint64_t frame) const;
+  bool slot_holds(const SharedFrameSlot *slot, uint64_t frame) const;
+  bool still_holds(const SharedFrameSlot *slot, uint64_t frame) const;
+
+  public:
+    /**
+     * Attach to the shared memory object `name`.
+     *
+     * @throws std::runtime_error if there is no such object or it is not a
+     *         frame ring.
+     */
+    explicit FrameSubscriber(const std::string &name);
+    ~FrameSubscriber();
+
+    FrameSubscriber(const FrameSubscriber&) = delete;
+    FrameSubscriber& operator=(const FrameSubscriber&) = delete;
+
+    uint32_t capacity() const;
+    float particle_radius() const;
+
+    /**
+     * The newest complete frame, 0 if none has been published.
+     */
+    uint64_t latest() const;
+
+    /**
+     * Call `copy(pos, step)` with the positions and step of the newest
+     * frame, if it is newer than `seen`. `copy` must only copy out of `pos`:
+     * if the writer overwrites the slot meanwhile, the copy is discarded and
+     * `copy` is called again with a newer frame.
+     *
+     * @returns The frame copied, or `seen` if there was no newer one or the
+     *          writer kept overwriting the slot being read.
+     */
+    template<typename F>
+    uint64_t read_latest(uint64_t seen, F &&copy) const {
+      for (uint32_t attempt = 0; attempt < SHARED_READ_RETRIES; attempt++) {
+        uint64_t frame = latest();
+        if (frame <= seen) {
+          return seen;
+        }
+
+        const SharedFrameSlot *frame_slot = slot(frame);
+        if (!slot_holds(frame_slot, frame)) {
+          continue;
+        }
+
+        // NOTE: The count may be torn along with the positions; clamp it so a
+        //       discarded copy still stays inside the slot.
+        const Vec3 *pos = reinterpret_cast<const Vec3*>(frame_slot + 1);
+        uint32_t count = std::min(frame_slot->particle_count, header->capacity);
+        copy(std::span<const Vec3>(pos, count), frame_slot->step);
+
+        if (still_holds(frame_slot, frame)) {
+          return frame;
+        }
+      }
+      return seen;
+    }
+};
@@ -1,24 +1,44 @@
 #include "sim.h"
 
+#include "arena.h"
+#include "checkpoint.h"
+#include "flow.h"
 #include "neighbours.h"
 #include "particles.h"
 #include "procs.h"
+#include "shared_frames.h"
+#include "task_pool.h"
 #include "timer.h"
+#include "tuner.h"
+#include <algorithm>
+#include <atomic>
+#include <csignal>
 #include <cstdint>
 #include <filesystem>
 #include <format>
+#include <memory>
 #include <libcommon/lib.h>
 #include <libcommon/matrix.h>
 #include <libcommon/vec.h>
 #include <print>
 #include <SDL3/SDL_gpu.h>
 #include <stdexcept>
+#include <vector>
 
+std::atomic<bool> _interrupted{false};
 
-Sim::Sim(std::filesystem::path exe_path, uint32_t particle_count, bool bench_mode)
-: sim_opts{bench_mode, particle_count, PARTICLE_RADIUS, GAS_CONSTANT, REST_DENSITY, SUPPORT, VISCOSITY_CONSTANT},
+void _interrupt(int) {
+  _interrupted.store(true, std::memory_order_relaxed);
+}
+
+
+Sim::Sim(std::filesystem::path exe_path, SimOpts sim_opts)
+: sim_opts{sim_opts},
   exe_path{exe_path},
-  timer(BENCH_LENGTH) {
+  timer(BENCH_LENGTH),
+  sdl_ctx{nullptr},
+  step_count{0},
+  step_fn{particles::step} {
     ps.resize(sim_opts.particle_count);
 }
 
@@ -32,9 +52,16 @@ bool Sim::copy_particles(libcommon::SDLCtx *sdl_ctx, SDL_GPUTransferBuffer *tbuf
     return false;
   }
 
+  // Only upload (and draw) the live particles, rounded up to whole
+  // workgroups of 64 with the spare slots parked out of view.
   const Sim *sim = static_cast<const Sim*>(sim_ctx);
-  for (int i = 0; i < sim->sim_opts.particle_count; i++) {
-    mapping[i].copy_vec3(sim->ps.pos.at(i));
+  uint32_t count = std::min<uint32_t>(sim->ps.size(), sdl_ctx->particle_count);
+  sdl_ctx->draw_count = std::min(((count + 63) / 64) * 64, sdl_ctx->particle_count);
+  for (uint32_t i = 0; i < count; i++) {
+    mapping[i].copy_vec3(sim->ps.pos[i]);
+  }
+  for (uint32_t i = count; i < sdl_ctx->draw_count; i++) {
+    mapping[i].copy_vec3(HIDDEN_POSITION);
   }
 
   SDL_UnmapGPUTransferBuffer(sdl_ctx->device, sdl_ctx->bufs.point_sprites.t);
@@ -43,26 +70,88 @@ bool Sim::copy_particles(libcommon::SDLCtx *sdl_ctx, SDL_GPUTransferBuffer *tbuf
 }
 
 void Sim::init() {
-  auto res = libcommon::initialize_and_setup(exe_path.parent_path().c_str(), sim_opts.particle_count);
+  // Threads are configured (and pinned) before the particle arrays are first
+  // touched by `reset` or a checkpoint load.
+  tuner::apply(sim_opts);
+
+  if (!sim_opts.load_path.empty()) {
+    auto loaded = checkpoint::load(sim_opts.load_path, ps, sim_opts);
+    if (!loaded) {
+      throw std::runtime_error(std::format("{}: {}", checkpoint::error_message(loaded.error()), sim_opts.load_path.string()));
+    }
+  }
+
+  if (!sim_opts.headless) {
+    auto res = libcommon::initialize_and_setup(exe_path.parent_path().c_str(), flow::capacity(sim_opts));
+
+    if (!res) {
+      throw std::runtime_error(std::format("{}", res.error()));
+    }
 
-  if (!res) {
-    throw std::runtime_error(std::format("{}", res.error()));
+    sdl_ctx = res.value();
+    sdl_ctx->uniforms.gen_point_sprites.particle_radius = sim_opts.particle_radius;
+  } else {
+    // Stop the loop on Ctrl+C so recordings and checkpoints still finish.
+    std::signal(SIGINT, _interrupt);
+    std::signal(SIGTERM, _interrupt);
   }
+  if (sim_opts.load_path.empty()) {
+    ps.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+  }
+  // Emitters and sinks then never reallocate the particle arrays.
+  ps.reserve(flow::capacity(sim_opts));
+
+  if (sim_opts.auto_tune) {
+    std::filesystem::path cache_path = exe_path.parent_path() / TUNE_CACHE_FILE;
+    auto cached = tuner::load_cached(cache_path, sim_opts);
+    if (cached) {
+      sim_opts = cached.value();
+    } else {
+      sim_opts = tuner::tune(ps, sim_opts);
+      tuner::store_cached(cache_path, sim_opts);
+    }
 
-  sdl_ctx = res.value();
-  sdl_ctx->uniforms.gen_point_sprites.particle_radius = sim_opts.particle_radius;
-  ps.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+    if (!sim_opts.bench_mode) {
+      std::println(
+        "Tuned: cell ratio {}, pruned {}, threads {}, block size {}",
+        sim_opts.cell_ratio, sim_opts.prune_stencil, sim_opts.thread_count, sim_opts.block_size
+      );
+    }
+  }
+  tuner::apply(sim_opts);
+  task_pool().reset_times();
+
+  if (!sim_opts.record_path.empty()) {
+    recorder = std::make_unique<Recorder>(
+      sim_opts.record_path,
+      flow::capacity(sim_opts),
+      sim_opts.record_fields,
+      sim_opts.record_interval
+    );
+  }
+
+  if (!sim_opts.shm_name.empty()) {
+    publisher = std::make_unique<FramePublisher>(
+      sim_opts.shm_name,
+      flow::capacity(sim_opts),
+      sim_opts.particle_radius,
+      sim_opts.shm_replace
+    );
+    publisher->publish(ps.pos, step_count);
+  }
 }
 
 void Sim::run_loop() {
   bool run = true;
   while (run) {
-    run = libcommon::update(sdl_ctx);
+    run = sdl_ctx ? libcommon::update(sdl_ctx) : !_interrupted.load(std::memory_order_relaxed);
 
     timer.record_start();
     update();
     timer.record_end();
-    draw();
+    if (sdl_ctx) {
+      draw();
+    }
 
     if (sim_opts.bench_mode && timer.recorded_frames() == BENCH_LENGTH) {
       run = false;
@@ -72,25 +161,60 @@ void Sim::run_loop() {
   if (sim_opts.bench_mode) {
     std::println("{}", timer.average_millis());
   }
+
+  if (sim_opts.thread_report) {
+    std::vector<ThreadTimes> times = task_pool().times();
+    for (size_t thread = 0; thread < times.size(); thread++) {
+      std::println("Thread {}: busy {:.2f} ms, idle {:.2f} ms", thread, times[thread].busy_millis, times[thread].idle_millis);
+    }
+  }
+
+  if (recorder) {
+    uint64_t dropped = recorder->dropped_frames();
+    if (dropped > 0 || recorder->failed()) {
+      std::println("Trajectory: dropped {} frames{}", dropped, recorder->failed() ? " (write failed)" : "");
+    }
+    recorder.reset();
+  }
+
+  if (!sim_opts.save_path.empty()) {
+    auto saved = checkpoint::save(sim_opts.save_path, ps, sim_opts);
+    if (!saved) {
+      throw std::runtime_error(std::format("{}: {}", checkpoint::error_message(saved.error()), sim_opts.save_path.string()));
+    }
+  }
+}
+
+void Sim::set_step_function(StepFunction fn) {
+  step_fn = fn;
 }
 
 void Sim::update() {
   // 1. Model View matrix.
   // degrees += 0.025f;
-  sdl_ctx->uniforms.gen_point_sprites.model_view = libcommon::matrix::translate_z(2.0f)
-                                                 * libcommon::matrix::rotation_x(-20);
+  if (sdl_ctx) {
+    sdl_ctx->uniforms.gen_point_sprites.model_view = libcommon::matrix::translate_z(2.0f)
+                                                   * libcommon::matrix::rotation_x(-20);
+  }
 
   // 2. Simulation.
-  ns.process(ps, sim_opts);
-  // TODO: Try these again.
-  // density_calculator.process(ps, ns, sim_opts);
-  // pressure_calculator.process(ps, ns, sim_opts);
-  // viscosity_calculator.process(ps, ns, sim_opts);
-  particles::calculate_density_pressure(ps, ns, sim_opts);
-  particles::calculate_pressure_forces(ps, ns, sim_opts);
-  particles::calculate_viscosity_forces(ps, ns, sim_opts);
-  particles::calculate_external_forces(ps);
-  particles::integrate(ps);
+  if (!sim_opts.emitters.empty()) {
+    flow::emit(ps, sim_opts, step_count);
+  }
+  step_fn(ps, ns, sim_opts);
+  step_count += 1;
+
+  // Scratch is scoped to each pass, so this only folds any overflow blocks
+  // from a step that outgrew the arena.
+  frame_arena().reset();
+
+  if (recorder) {
+    recorder->record(ps, step_count);
+  }
+
+  if (publisher) {
+    publisher->publish(ps.pos, step_count);
+  }
 }
 
 void Sim::draw() {
@@ -2,14 +2,21 @@
 
 #include "neighbours.h"
 #include "particles.h"
+#include "recorder.h"
+#include "shared_frames.h"
 #include "sim_opts.h"
 #include "timer.h"
 #include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <memory>
 #include <libcommon/lib.h>
 #include <libcommon/vec.h>
 
 
+// Advances the particles by one time step. Defaults to `particles::step`.
+using StepFunction = std::function<void(Particles &ps, Neighbours &ns, const SimOpts &opts)>;
+
 class Sim {
   std::filesystem::path exe_path;
   FrameTimer timer;
@@ -19,13 +26,24 @@ class Sim {
   Particles ps;
 
   Neighbours ns;
+  uint64_t step_count;
+
+  std::unique_ptr<Recorder> recorder;
+  std::unique_ptr<FramePublisher> publisher;
+  StepFunction step_fn;
 
   static bool copy_particles(libcommon::SDLCtx *sdl_ctx, SDL_GPUTransferBuffer *tbuf, const void *sim_ctx);
   void update();
   void draw();
 
   public:
-    Sim(std::filesystem::path exe_path, uint32_t particle_count, bool bench_mode);
+    Sim(std::filesystem::path exe_path, SimOpts sim_opts);
+
+    /**
+     * Replace how `update` steps the particles, e.g. to step a distributed
+     * domain and gather the result.
+     */
+    void set_step_function(StepFunction fn);
 
     void init();
     void run_loop();
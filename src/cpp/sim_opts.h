@@ -1,12 +1,43 @@
 #pragma once
 
+#include "backend.h"
 #include <cstdint>
+#include <filesystem>
 #include <libcommon/vec.h>
+#include <string>
+#include <vector>
 
 constexpr uint32_t BENCH_LENGTH = 300; // frames
+constexpr float TIME_STEP = 1.0f / 60; // seconds per frame
+constexpr float PCISPH_TIME_STEP = 3 * TIME_STEP; // default with --pcisph
 constexpr Vec2 X_BOUNDS{-1.0f, 1.0f};
 constexpr Vec2 Y_BOUNDS{-1.0f, 1.0f};
 constexpr Vec2 Z_BOUNDS{-1.0f, 1.0f};
+constexpr uint32_t MAX_CELL_RATIO = 3;
+constexpr uint32_t MAX_TIME_LEVELS = 6;
+
+enum class PressureSolver {
+  // Pressure straight from density, `gas_constant * (density - rest_density)`.
+  EquationOfState,
+  // Predictive-corrective incompressible SPH: iterate pressures until the
+  // predicted density error is within `pcisph_tolerance`.
+  Pcisph,
+};
+
+// Releases `rate` particles each step, spread over a horizontal disc of
+// `radius` around `centre`, all moving at `velocity`.
+struct Emitter {
+  Vec3 centre;
+  Vec3 velocity;
+  float radius;
+  uint32_t rate;
+};
+
+// Removes every particle inside the box from `low` to `high`.
+struct Sink {
+  Vec3 low;
+  Vec3 high;
+};
 
 struct SimOpts {
   bool bench_mode;
@@ -16,4 +47,113 @@ struct SimOpts {
   float rest_density;
   float support;
   float viscosity_constant;
+
+  // Simulated seconds per step (per frame).
+  float time_step = TIME_STEP;
+
+  // How pressures are found. PCISPH runs up to `pcisph_max_iterations`
+  // corrections, stopping once the average density compression is within
+  // `pcisph_tolerance` of the rest density. It stays stable at
+  // PCISPH_TIME_STEP in the fountain scene, where the equation of state is
+  // not, and a simulated second then costs about a third as much. Fuller
+  // boxes (2048 particles) are calmer at 2x TIME_STEP. A box that can not
+  // hold the fluid at rest density, about `particle_count / rest_density`
+  // of volume, aims for filling the box instead. Overrides `task_graph` and
+  // `time_levels`.
+  PressureSolver pressure_solver = PressureSolver::EquationOfState;
+  float pcisph_tolerance = 0.02f;
+  uint32_t pcisph_max_iterations = 20;
+
+  // Neighbour grid cells are `support / cell_ratio` wide and searched with a
+  // (2 * cell_ratio + 1)^3 stencil. Pruning drops stencil cells that can not
+  // intersect the support sphere.
+  uint32_t cell_ratio = 1;
+  bool prune_stencil = false;
+
+  // Find grid cells from positions quantized to FIXED_POINT_BITS bit
+  // integers across the box: per axis a clamp, a multiply and a shift, with
+  // no boundary fix-ups. Positions within about 1e-6 of a cell face can land
+  // in the cell beside the one the float path picks (see the "Fixed Point
+  // Cells" test). The stencil still reaches their neighbours only because
+  // `Neighbours::grid_width_for` rounds the cell count down, so cells are
+  // wider than `support / cell_ratio` by much more than that. A support that
+  // divides the box exactly leaves no such slack.
+  bool fixed_point_cells = false;
+
+  // Run the density and force passes a grid cell at a time: each cell's
+  // particles are copied into small structure of arrays tiles and summed
+  // against tiles of each stencil cell, so neighbour data is loaded once per
+  // cell rather than once per particle. Sub-steps of `time_levels` and the
+  // PCISPH density prediction keep the per particle passes.
+  bool tiled_cells = false;
+
+  // How the solver loops run. See exec::Backend.
+  exec::Backend backend = exec::DEFAULT_BACKEND;
+
+  // Sum neighbours in a fixed order so that runs repeat bitwise.
+  bool reproducible = false;
+
+  // Run density, forces and integration as a graph of per cell block tasks
+  // on the task pool, with no barriers between the passes. Overrides
+  // `backend` for everything but the sort.
+  bool task_graph = false;
+
+  // Skip the force passes and integration for grid cells that have settled
+  // (see Neighbours::cell_asleep), so a step costs roughly in proportion to
+  // the fluid still in motion. Sleeping particles are frozen in place until
+  // disturbed, so results differ from a run without it.
+  bool sleep_cells = false;
+
+  // Number of power-of-two time step levels. Each step runs
+  // 2^(time_levels - 1) sub-steps, and a particle at level l only recomputes
+  // its forces every 2^(time_levels - 1 - l) of them, with l picked from its
+  // speed and acceleration (CFL_FACTOR). One level is a single step per
+  // frame. More than one overrides `task_graph`.
+  uint32_t time_levels = 1;
+
+  // Worker threads for the parallel build, and the most grid cells in one
+  // force pass block. Zero keeps the runtime default / cuts blocks by
+  // estimated cost alone.
+  uint32_t thread_count = 0;
+  uint32_t block_size = 0;
+
+  // Pin each worker thread to its own core, spread evenly over the CPUs the
+  // process may run on.
+  bool pin_threads = false;
+
+  // Print per-thread busy and idle time of the force passes on exit.
+  bool thread_report = false;
+
+  // Pick the fields above by benchmarking at startup (or from the cache).
+  bool auto_tune = false;
+
+  // Start from / finish by writing a checkpoint when not empty.
+  std::filesystem::path load_path{};
+  std::filesystem::path save_path{};
+
+  // Record every `record_interval`-th step to a trajectory file when not
+  // empty. `record_fields` is a mask of TrajectoryField values.
+  std::filesystem::path record_path{};
+  uint32_t record_interval = 1;
+  uint32_t record_fields = 0;
+
+  // Publish every step's positions to the shared memory frame ring
+  // `shm_name` (e.g. "/sph") when not empty, for sph-viewer to draw. An
+  // existing ring of that name is an error unless `shm_replace` is set.
+  // Headless skips the window so drawing never holds up the solver; it runs
+  // until bench mode finishes or the process is interrupted.
+  std::string shm_name{};
+  bool shm_replace = false;
+  bool headless = false;
+
+  // Add particles from `emitters` every step, up to `particle_capacity`
+  // (never below `particle_count`, which the run starts with), and remove
+  // those that reach a sink. See flow.h.
+  std::vector<Emitter> emitters{};
+  std::vector<Sink> sinks{};
+  uint32_t particle_capacity = 0;
+
+  // Push particles up the fountain column (see external_force). Off when an
+  // inlet emitter makes the fountain instead.
+  bool fountain_force = true;
 };
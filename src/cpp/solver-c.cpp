@@ -0,0 +1,146 @@
+#include "solver-c.h"
+
+#include "arena.h"
+#include "backend.h"
+#include "neighbours.h"
+#include "particles.h"
+#include "procs.h"
+#include "sim_opts.h"
+#include "tuner.h"
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+
+constexpr uint32_t DEFAULT_PARTICLE_COUNT = 1024;
+
+struct SphSolver {
+  SimOpts opts;
+  Particles ps;
+  Neighbours ns;
+  uint64_t step_count = 0;
+};
+
+std::optional<exec::Backend> _backend(SphBackend backend) {
+  switch (backend) {
+    case SPH_BACKEND_DEFAULT: return exec::DEFAULT_BACKEND;
+    case SPH_BACKEND_SERIAL: return exec::Backend::Serial;
+    case SPH_BACKEND_OPENMP: return exec::Backend::OpenMP;
+    case SPH_BACKEND_STDPAR: return exec::Backend::StdPar;
+    case SPH_BACKEND_POOL: return exec::Backend::ThreadPool;
+  }
+  return std::nullopt;
+}
+
+std::optional<SimOpts> _sim_opts(const SphOptions &opts) {
+  auto backend = _backend(opts.backend);
+  if (!backend
+      || opts.particle_count == 0
+      || !(opts.particle_radius > 0.0f)
+      || !(opts.rest_density > 0.0f)
+      || !(opts.support > 0.0f)
+      || !(opts.time_step > 0.0f)
+      || opts.cell_ratio < 1 || opts.cell_ratio > MAX_CELL_RATIO
+      || opts.time_levels < 1 || opts.time_levels > MAX_TIME_LEVELS) {
+    return std::nullopt;
+  }
+
+  SimOpts sim_opts{
+    .bench_mode = false,
+    .particle_count = opts.particle_count,
+    .particle_radius = opts.particle_radius,
+    .gas_constant = opts.gas_constant,
+    .rest_density = opts.rest_density,
+    .support = opts.support,
+    .viscosity_constant = opts.viscosity_constant,
+    .time_step = opts.time_step,
+    .pressure_solver = (opts.flags & SPH_PCISPH) ? PressureSolver::Pcisph : PressureSolver::EquationOfState,
+    .cell_ratio = opts.cell_ratio,
+    .prune_stencil = (opts.flags & SPH_PRUNE_STENCIL) != 0,
+    .backend = backend.value(),
+    .reproducible = (opts.flags & SPH_REPRODUCIBLE) != 0,
+    .task_graph = (opts.flags & SPH_TASK_GRAPH) != 0,
+    .sleep_cells = (opts.flags & SPH_SLEEP_CELLS) != 0,
+    .time_levels = opts.time_levels,
+    .thread_count = opts.thread_count,
+  };
+  return sim_opts;
+}
+
+extern "C" {
+
+  void sph_default_options(SphOptions *opts) {
+    if (!opts) { return; }
+    SimOpts defaults{};
+    *opts = SphOptions{
+      .particle_count = DEFAULT_PARTICLE_COUNT,
+      .particle_radius = PARTICLE_RADIUS,
+      .gas_constant = GAS_CONSTANT,
+      .rest_density = REST_DENSITY,
+      .support = SUPPORT,
+      .viscosity_constant = VISCOSITY_CONSTANT,
+      .time_step = defaults.time_step,
+      .cell_ratio = defaults.cell_ratio,
+      .time_levels = defaults.time_levels,
+      .thread_count = 0,
+      .backend = SPH_BACKEND_DEFAULT,
+      .flags = 0,
+    };
+  }
+
+  SphError sph_create(const SphOptions *opts, SphSolver **solver) {
+    if (!opts || !solver) { return SPH_BAD_OPTIONS; }
+    auto sim_opts = _sim_opts(*opts);
+    if (!sim_opts) {
+      return SPH_BAD_OPTIONS;
+    }
+
+    // NOTE: No exception may cross into the caller's language.
+    try {
+      auto created = std::make_unique<SphSolver>();
+      created->opts = sim_opts.value();
+      // Threads are configured before the particle arrays are first touched,
+      // like Sim::init.
+      tuner::apply(created->opts);
+      created->ps.reset(created->opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+      *solver = created.release();
+      return SPH_OK;
+    } catch (const std::exception&) {
+      return SPH_FAILED;
+    }
+  }
+
+  void sph_destroy(SphSolver *solver) {
+    delete solver;
+  }
+
+  SphError sph_step(SphSolver *solver, uint32_t steps) {
+    if (!solver) { return SPH_BAD_OPTIONS; }
+
+    try {
+      for (uint32_t i = 0; i < steps; i++) {
+        particles::step(solver->ps, solver->ns, solver->opts);
+        solver->step_count += 1;
+      }
+      frame_arena().reset();
+      return SPH_OK;
+    } catch (const std::exception&) {
+      return SPH_FAILED;
+    }
+  }
+
+  const float *sph_positions(const SphSolver *solver, uint32_t *count) {
+    if (!solver) {
+      if (count) { *count = 0; }
+      return nullptr;
+    }
+
+    // NOTE: Vec3 is three packed floats (see libcommon/vec.h).
+    if (count) { *count = static_cast<uint32_t>(solver->ps.size()); }
+    return reinterpret_cast<const float*>(solver->ps.pos.data());
+  }
+
+  uint64_t sph_step_count(const SphSolver *solver) {
+    return solver ? solver->step_count : 0;
+  }
+};
@@ -0,0 +1,93 @@
+/* C API of the solver core, for FFI callers (Pony, Python, test drivers).
+ * Everything here is plain C so the header can be read by C compilers and
+ * binding generators alike. */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t SphError;
+enum {
+  SPH_OK          = 0,
+  SPH_BAD_OPTIONS = 1,
+  SPH_FAILED      = 2, /* Out of memory or another failure inside the solver. */
+};
+
+typedef uint32_t SphBackend;
+enum {
+  SPH_BACKEND_DEFAULT = 0, /* The build's default. */
+  SPH_BACKEND_SERIAL  = 1,
+  SPH_BACKEND_OPENMP  = 2,
+  SPH_BACKEND_STDPAR  = 3,
+  SPH_BACKEND_POOL    = 4,
+};
+
+/* Bits of SphOptions::flags, each switching on one option of the C++ SimOpts. */
+enum {
+  SPH_REPRODUCIBLE  = 1 << 0,
+  SPH_TASK_GRAPH    = 1 << 1,
+  SPH_SLEEP_CELLS   = 1 << 2,
+  SPH_PRUNE_STENCIL = 1 << 3,
+  SPH_PCISPH        = 1 << 4,
+};
+
+/* See SimOpts for what each field does. Start from sph_default_options so
+ * fields added later keep their defaults. */
+typedef struct SphOptions {
+  uint32_t particle_count;
+  float particle_radius;
+  float gas_constant;
+  float rest_density;
+  float support;
+  float viscosity_constant;
+  float time_step;
+  uint32_t cell_ratio;
+  uint32_t time_levels;
+  uint32_t thread_count; /* 0 keeps the runtime default. */
+  SphBackend backend;
+  uint32_t flags;
+} SphOptions;
+
+typedef struct SphSolver SphSolver;
+
+/**
+ * Fill `opts` with the defaults of sph-cpp.
+ */
+void sph_default_options(SphOptions *opts);
+
+/**
+ * Create a solver holding `opts->particle_count` particles in their starting
+ * positions. Sets the process wide thread count when `opts->thread_count` is
+ * not 0.
+ *
+ * @returns SPH_OK and the solver in `*solver`, or SPH_BAD_OPTIONS if an
+ *          option is out of range.
+ */
+SphError sph_create(const SphOptions *opts, SphSolver **solver);
+
+void sph_destroy(SphSolver *solver);
+
+/**
+ * Advance the simulation by `steps` time steps.
+ */
+SphError sph_step(SphSolver *solver, uint32_t steps);
+
+/**
+ * Borrow the particle positions: `*count` packed x, y, z float triples.
+ * Only valid until the next sph_step or sph_destroy. The particles are kept
+ * sorted by grid cell, so a particle's index changes between steps.
+ */
+const float *sph_positions(const SphSolver *solver, uint32_t *count);
+
+/**
+ * Steps taken since sph_create.
+ */
+uint64_t sph_step_count(const SphSolver *solver);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,346 @@
+#include "task_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+uint64_t _now_nanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()
+  ).count();
+}
+
+void TaskGraph::close_tasks_before(uint32_t task) {
+  while (successor_starts.size() < task) {
+    successor_starts.push_back(successor_list.size());
+  }
+}
+
+void TaskGraph::reset(size_t task_count) {
+  dependency_counts.assign(task_count, 0);
+  successor_starts.clear();
+  successor_list.clear();
+}
+
+void TaskGraph::add_edge(uint32_t from, uint32_t to) {
+  close_tasks_before(from + 1);
+  successor_list.push_back(to);
+  dependency_counts[to] += 1;
+}
+
+size_t TaskGraph::size() const {
+  return dependency_counts.size();
+}
+
+uint32_t TaskGraph::dependencies(uint32_t task) const {
+  return dependency_counts[task];
+}
+
+std::span<const uint32_t> TaskGraph::successors(uint32_t task) const {
+  // Tasks after the last one with an edge have no successors.
+  if (task >= successor_starts.size()) {
+    return {};
+  }
+  size_t end = (task + 1 < successor_starts.size()) ? successor_starts[task + 1] : successor_list.size();
+  return std::span(successor_list).subspan(successor_starts[task], end - successor_starts[task]);
+}
+
+TaskPool::TaskPool(size_t workers)
+: worker_count{0},
+  generation{0},
+  checked_in{0},
+  job_fn{nullptr},
+  job_ctx{nullptr},
+  job_graph{nullptr},
+  pending_capacity{0},
+  remaining{0},
+  wall_nanos{0} {
+  resize(workers);
+}
+
+TaskPool::~TaskPool() {
+  resize(0);
+}
+
+void TaskPool::resize(size_t new_count) {
+  if (new_count == worker_count && new_count != 0) {
+    return;
+  }
+
+  // NOTE: Stop under the job lock, like a dispatch, so no worker can check
+  //       the wait predicate and then miss the wake up.
+  {
+    std::lock_guard guard(job_lock);
+    for (std::jthread &thread : threads) {
+      thread.request_stop();
+    }
+  }
+  job_ready.notify_all();
+  threads.clear();
+
+  worker_count = new_count;
+  workers = (new_count > 0) ? std::make_unique<Worker[]>(new_count) : nullptr;
+  wall_nanos = 0;
+
+  for (size_t w = 1; w < worker_count; w++) {
+    threads.emplace_back([this, w, start = generation](std::stop_token stop) { worker_loop(stop, w, start); });
+  }
+}
+
+size_t TaskPool::size() const {
+  return worker_count;
+}
+
+std::vector<std::jthread> &TaskPool::worker_threads() {
+  return threads;
+}
+
+void TaskPool::run_tasks(void (*fn)(void *ctx, size_t task), void *ctx, size_t task_count, std::span<const uint64_t> costs) {
+  uint64_t start = _now_nanos();
+
+  if (worker_count <= 1 || task_count <= 1) {
+    for (size_t i = 0; i < task_count; i++) {
+      fn(ctx, i);
+    }
+    uint64_t elapsed = _now_nanos() - start;
+    if (worker_count > 0) {
+      workers[0].busy_nanos += elapsed;
+    }
+    wall_nanos += elapsed;
+    return;
+  }
+
+  // Give each worker a contiguous run of tasks holding about an equal share
+  // of the total cost. Contiguous runs keep neighbouring cells on one worker.
+  // Without costs every task counts as 1.
+  auto cost_of = [&](size_t task) -> uint64_t { return costs.empty() ? 1 : costs[task]; };
+  uint64_t total_cost = 0;
+  for (size_t task = 0; task < task_count; task++) {
+    total_cost += cost_of(task);
+  }
+
+  size_t task = 0;
+  uint64_t cumulative = 0;
+  for (size_t w = 0; w < worker_count; w++) {
+    uint64_t share_end = (total_cost * (w + 1)) / worker_count;
+    std::lock_guard guard(workers[w].lock);
+    workers[w].next = task;
+    while (task < task_count && (cumulative < share_end || w == worker_count - 1)) {
+      cumulative += cost_of(task);
+      task += 1;
+    }
+    workers[w].end = task;
+  }
+
+  dispatch(fn, ctx, nullptr);
+  wall_nanos += _now_nanos() - start;
+}
+
+void TaskPool::run_graph_tasks(void (*fn)(void *ctx, size_t task), void *ctx, const TaskGraph &graph) {
+  size_t task_count = graph.size();
+  uint64_t start = _now_nanos();
+
+  // Only reallocates when the graph outgrows every earlier one.
+  if (pending_capacity < task_count) {
+    pending = std::make_unique<std::atomic<uint32_t>[]>(task_count);
+    pending_capacity = task_count;
+  }
+  for (size_t w = 0; w < worker_count; w++) {
+    if (workers[w].ready.size() < task_count) {
+      workers[w].ready.resize(task_count);
+    }
+    workers[w].ready_front = 0;
+    workers[w].ready_back = 0;
+  }
+
+  // Spread the tasks that are ready from the start over the workers in
+  // contiguous runs, like `run` does.
+  size_t root_count = 0;
+  for (uint32_t task = 0; task < task_count; task++) {
+    uint32_t dependencies = graph.dependencies(task);
+    pending[task].store(dependencies, std::memory_order_relaxed);
+    root_count += (dependencies == 0);
+  }
+
+  size_t root = 0;
+  for (uint32_t task = 0; task < task_count; task++) {
+    if (graph.dependencies(task) == 0) {
+      size_t worker = (root * worker_count) / root_count;
+      push_ready(worker, task);
+      root += 1;
+    }
+  }
+
+  // Owners pop the back of their queue, so flip each run to start with its
+  // first task.
+  for (size_t w = 0; w < worker_count; w++) {
+    Worker &worker = workers[w];
+    std::reverse(worker.ready.begin() + worker.ready_front, worker.ready.begin() + worker.ready_back);
+  }
+
+  remaining.store(task_count, std::memory_order_relaxed);
+  dispatch(fn, ctx, &graph);
+  wall_nanos += _now_nanos() - start;
+}
+
+void TaskPool::dispatch(void (*fn)(void *ctx, size_t task), void *ctx, const TaskGraph *graph) {
+  {
+    std::lock_guard guard(job_lock);
+    job_fn = fn;
+    job_ctx = ctx;
+    job_graph = graph;
+    checked_in = 0;
+    generation += 1;
+  }
+  job_ready.notify_all();
+
+  if (graph) {
+    work_graph(0);
+  } else {
+    work(0);
+  }
+
+  // The job context lives on the caller's stack, so wait until every worker
+  // thread has finished with it.
+  std::unique_lock guard(job_lock);
+  job_done.wait(guard, [this] { return checked_in == worker_count - 1; });
+  job_fn = nullptr;
+  job_ctx = nullptr;
+  job_graph = nullptr;
+}
+
+void TaskPool::work(size_t worker) {
+  while (true) {
+    size_t task = SIZE_MAX;
+
+    {
+      Worker &own = workers[worker];
+      std::lock_guard guard(own.lock);
+      if (own.next < own.end) {
+        task = own.next;
+        own.next += 1;
+      }
+    }
+
+    for (size_t offset = 1; task == SIZE_MAX && offset < worker_count; offset++) {
+      Worker &victim = workers[(worker + offset) % worker_count];
+      std::lock_guard guard(victim.lock);
+      if (victim.next < victim.end) {
+        victim.end -= 1;
+        task = victim.end;
+      }
+    }
+
+    if (task == SIZE_MAX) {
+      return;
+    }
+
+    uint64_t start = _now_nanos();
+    job_fn(job_ctx, task);
+    workers[worker].busy_nanos += _now_nanos() - start;
+  }
+}
+
+void TaskPool::push_ready(size_t worker, uint32_t task) {
+  Worker &own = workers[worker];
+  std::lock_guard guard(own.lock);
+  own.ready[own.ready_back] = task;
+  own.ready_back += 1;
+}
+
+void TaskPool::work_graph(size_t worker) {
+  while (remaining.load(std::memory_order_acquire) > 0) {
+    uint32_t task = UINT32_MAX;
+
+    {
+      Worker &own = workers[worker];
+      std::lock_guard guard(own.lock);
+      if (own.ready_front < own.ready_back) {
+        own.ready_back -= 1;
+        task = own.ready[own.ready_back];
+      }
+    }
+
+    for (size_t offset = 1; task == UINT32_MAX && offset < worker_count; offset++) {
+      Worker &victim = workers[(worker + offset) % worker_count];
+      std::lock_guard guard(victim.lock);
+      if (victim.ready_front < victim.ready_back) {
+        task = victim.ready[victim.ready_front];
+        victim.ready_front += 1;
+      }
+    }
+
+    // Everything left is waiting on tasks still running elsewhere.
+    if (task == UINT32_MAX) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    uint64_t start = _now_nanos();
+    job_fn(job_ctx, task);
+    workers[worker].busy_nanos += _now_nanos() - start;
+
+    for (uint32_t successor : job_graph->successors(task)) {
+      if (pending[successor].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        push_ready(worker, successor);
+      }
+    }
+    remaining.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+void TaskPool::worker_loop(std::stop_token stop, size_t worker, uint64_t seen_generation) {
+  const TaskGraph *graph = nullptr;
+
+  while (true) {
+    {
+      std::unique_lock guard(job_lock);
+      job_ready.wait(guard, [&] { return stop.stop_requested() || generation != seen_generation; });
+      if (stop.stop_requested()) {
+        return;
+      }
+      seen_generation = generation;
+      graph = job_graph;
+    }
+
+    if (graph) {
+      work_graph(worker);
+    } else {
+      work(worker);
+    }
+
+    {
+      std::lock_guard guard(job_lock);
+      checked_in += 1;
+    }
+    job_done.notify_one();
+  }
+}
+
+std::vector<ThreadTimes> TaskPool::times() const {
+  std::vector<ThreadTimes> result;
+  for (size_t w = 0; w < worker_count; w++) {
+    uint64_t busy = workers[w].busy_nanos;
+    uint64_t idle = (wall_nanos > busy) ? (wall_nanos - busy) : 0;
+    result.push_back(ThreadTimes{ busy / 1e6, idle / 1e6 });
+  }
+  return result;
+}
+
+void TaskPool::reset_times() {
+  for (size_t w = 0; w < worker_count; w++) {
+    workers[w].busy_nanos = 0;
+  }
+  wall_nanos = 0;
+}
+
+TaskPool &task_pool() {
+  static TaskPool pool;
+  return pool;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+struct ThreadTimes {
+  double busy_millis;
+  double idle_millis;
+};
+
+/**
+ * Tasks and their dependencies, as a successor list per task (compressed
+ * sparse rows). A task may run once all tasks with an edge to it are done.
+ */
+class TaskGraph {
+  std::vector<uint32_t> dependency_counts;
+  std::vector<uint32_t> successor_starts;
+  std::vector<uint32_t> successor_list;
+
+  void close_tasks_before(uint32_t task);
+
+  public:
+    /**
+     * Start a new graph of `task_count` tasks and no edges. Keeps the
+     * storage of the previous graph.
+     */
+    void reset(size_t task_count);
+
+    /**
+     * Make `to` wait for `from`. Edges must be added in increasing order of
+     * `from`.
+     */
+    void add_edge(uint32_t from, uint32_t to);
+
+    size_t size() const;
+    uint32_t dependencies(uint32_t task) const;
+    std::span<const uint32_t> successors(uint32_t task) const;
+};
+
+/**
+ * Persistent worker threads that run a batch of indexed tasks with work
+ * stealing.
+ *
+ * Tasks are split into one contiguous run per worker, balanced by their
+ * estimated cost. Each worker takes tasks from the front of its own run and,
+ * once that is empty, steals from the back of the others. The calling thread
+ * acts as worker 0, so a pool of size 1 simply runs every task inline.
+ *
+ * A TaskGraph runs the same way, except that tasks are queued once their
+ * dependencies finish: on the worker that finished the last one, which takes
+ * its newest task first and so stays on data that is still in cache.
+ */
+class TaskPool {
+  struct alignas(64) Worker {
+    std::mutex lock;
+    size_t next = 0; // Owner takes tasks from here...
+    size_t end = 0;  // ...thieves from just before here.
+    // Ready queue of a task graph. Owner pops the back, thieves the front.
+    std::vector<uint32_t> ready;
+    size_t ready_front = 0;
+    size_t ready_back = 0;
+    uint64_t busy_nanos = 0;
+  };
+
+  size_t worker_count;
+  std::unique_ptr<Worker[]> workers;
+  std::vector<std::jthread> threads;
+
+  std::mutex job_lock;
+  std::condition_variable job_ready;
+  std::condition_variable job_done;
+  uint64_t generation;
+  size_t checked_in;
+  void (*job_fn)(void *ctx, size_t task);
+  void *job_ctx;
+  const TaskGraph *job_graph;
+  std::unique_ptr<std::atomic<uint32_t>[]> pending;
+  size_t pending_capacity;
+  std::atomic<size_t> remaining;
+  uint64_t wall_nanos;
+
+  void run_tasks(void (*fn)(void *ctx, size_t task), void *ctx, size_t task_count, std::span<const uint64_t> costs);
+  void run_graph_tasks(void (*fn)(void *ctx, size_t task), void *ctx, const TaskGraph &graph);
+  void dispatch(void (*fn)(void *ctx, size_t task), void *ctx, const TaskGraph *graph);
+  void work(size_t worker);
+  void work_graph(size_t worker);
+  void push_ready(size_t worker, uint32_t task);
+
+  template<typename F>
+  static void _call(void *ctx, size_t task) {
+    (*static_cast<std::remove_reference_t<F>*>(ctx))(task);
+  }
+
+  template<typename F>
+  static void *_context(F &task) {
+    return const_cast<void*>(static_cast<const void*>(&task));
+  }
+
+  void worker_loop(std::stop_token stop, size_t worker, uint64_t seen_generation);
+
+  public:
+    explicit TaskPool(size_t workers = 1);
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    /**
+     * Change the number of workers (including the calling thread).
+     */
+    void resize(size_t workers);
+    size_t size() const;
+
+    /**
+     * Worker thread handles, for pinning. Worker 0 (the caller) has none.
+     */
+    std::vector<std::jthread> &worker_threads();
+
+    /**
+     * Run `task(i)` for every `i` in [0, costs.size()) and wait for all of
+     * them. `costs[i]` estimates the relative cost of task `i`.
+     */
+    template<typename F>
+    void run(std::span<const uint64_t> costs, F &&task) {
+      run_tasks(_call<F>, _context(task), costs.size(), costs);
+    }
+
+    /**
+     * As above for `task_count` tasks of equal cost.
+     */
+    template<typename F>
+    void run(size_t task_count, F &&task) {
+      run_tasks(_call<F>, _context(task), task_count, {});
+    }
+
+    /**
+     * Run `task(i)` for every task `i` of `graph`, each only after all of
+     * its dependencies, and wait for all of them.
+     */
+    template<typename F>
+    void run_graph(const TaskGraph &graph, F &&task) {
+      run_graph_tasks(_call<F>, _context(task), graph);
+    }
+
+    /**
+     * Busy and idle time per worker while running tasks, since the last
+     * `reset_times`.
+     */
+    std::vector<ThreadTimes> times() const;
+    void reset_times();
+};
+
+/**
+ * The pool shared by all force passes.
+ */
+TaskPool &task_pool();
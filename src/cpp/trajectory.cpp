@@ -0,0 +1,142 @@
+#include "trajectory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <libcommon/vec.h>
+#include <span>
+
+namespace trajectory {
+  constexpr float U16_MAX = 65535.0f;
+  constexpr float I16_MAX = 32767.0f;
+
+  uint16_t _quantize(float value, float low, float high) {
+    if (!(high > low)) {
+      return 0;
+    }
+    float t = std::clamp((value - low) / (high - low), 0.0f, 1.0f);
+    return static_cast<uint16_t>(std::lround(t * U16_MAX));
+  }
+
+  uint64_t frame_size(uint32_t capacity, uint32_t fields) {
+    uint64_t size = sizeof(FrameHeader) + (sizeof(uint16_t) * 3 * capacity);
+    if (fields & TRAJ_VELOCITY) {
+      size += sizeof(int16_t) * 3 * capacity;
+    }
+    if (fields & TRAJ_DENSITY) {
+      size += sizeof(uint16_t) * capacity;
+    }
+    // Keep every frame 8 byte aligned for the FrameHeader.
+    return (size + 7) & ~uint64_t{7};
+  }
+
+  void encode_frame(
+    const TrajectoryHeader &header,
+    uint64_t step,
+    std::span<const Vec3> pos,
+    std::span<const Vec3> vel,
+    std::span<const float> density,
+    std::byte *out
+  ) {
+    uint32_t count = static_cast<uint32_t>(std::min<size_t>(pos.size(), header.capacity));
+    FrameHeader frame{
+      .step = step,
+      .particle_count = count,
+      .vel_scale = 0.0f,
+      .density_scale = 0.0f,
+      ._padding = 0,
+    };
+
+    if (header.fields & TRAJ_VELOCITY) {
+      for (uint32_t i = 0; i < count; i++) {
+        frame.vel_scale = std::max({
+          frame.vel_scale,
+          std::abs(vel[i].x()),
+          std::abs(vel[i].y()),
+          std::abs(vel[i].z()),
+        });
+      }
+    }
+    if (header.fields & TRAJ_DENSITY) {
+      for (uint32_t i = 0; i < count; i++) {
+        frame.density_scale = std::max(frame.density_scale, density[i]);
+      }
+    }
+
+    std::memset(out, 0, header.frame_size);
+    std::memcpy(out, &frame, sizeof(FrameHeader));
+
+    uint16_t *qpos = reinterpret_cast<uint16_t*>(out + sizeof(FrameHeader));
+    for (uint32_t i = 0; i < count; i++) {
+      qpos[(3 * i) + 0] = _quantize(pos[i].x(), header.bounds_min, header.bounds_max);
+      qpos[(3 * i) + 1] = _quantize(pos[i].y(), header.bounds_min, header.bounds_max);
+      qpos[(3 * i) + 2] = _quantize(pos[i].z(), header.bounds_min, header.bounds_max);
+    }
+    std::byte *next = out + sizeof(FrameHeader) + (sizeof(uint16_t) * 3 * header.capacity);
+
+    if (header.fields & TRAJ_VELOCITY) {
+      int16_t *qvel = reinterpret_cast<int16_t*>(next);
+      float scale = (frame.vel_scale > 0.0f) ? (I16_MAX / frame.vel_scale) : 0.0f;
+      for (uint32_t i = 0; i < count; i++) {
+        qvel[(3 * i) + 0] = static_cast<int16_t>(std::lround(vel[i].x() * scale));
+        qvel[(3 * i) + 1] = static_cast<int16_t>(std::lround(vel[i].y() * scale));
+        qvel[(3 * i) + 2] = static_cast<int16_t>(std::lround(vel[i].z() * scale));
+      }
+      next += sizeof(int16_t) * 3 * header.capacity;
+    }
+
+    if (header.fields & TRAJ_DENSITY) {
+      uint16_t *qdensity = reinterpret_cast<uint16_t*>(next);
+      for (uint32_t i = 0; i < count; i++) {
+        qdensity[i] = _quantize(density[i], 0.0f, frame.density_scale);
+      }
+    }
+  }
+
+  uint32_t decode_positions(const TrajectoryHeader &header, const std::byte *frame, std::span<Vec3> pos) {
+    FrameHeader frame_header;
+    std::memcpy(&frame_header, frame, sizeof(FrameHeader));
+
+    uint32_t count = std::min<uint32_t>(frame_header.particle_count, static_cast<uint32_t>(pos.size()));
+    const uint16_t *qpos = reinterpret_cast<const uint16_t*>(frame + sizeof(FrameHeader));
+    const float scale = (header.bounds_max - header.bounds_min) / U16_MAX;
+
+    for (uint32_t i = 0; i < count; i++) {
+      pos[i] = Vec3{
+        header.bounds_min + (qpos[(3 * i) + 0] * scale),
+        header.bounds_min + (qpos[(3 * i) + 1] * scale),
+        header.bounds_min + (qpos[(3 * i) + 2] * scale),
+      };
+    }
+
+    return count;
+  }
+
+  bool advance_playback(double &position, double rate, uint64_t frame_count, bool loop) {
+    position += rate;
+    if (position < frame_count) {
+      return true;
+    }
+    if (loop) {
+      position = std::fmod(position, static_cast<double>(frame_count));
+      return true;
+    }
+    position = static_cast<double>(frame_count - 1);
+    return false;
+  }
+
+  size_t upcoming_frames(double position, double rate, uint64_t frame_count, bool loop, std::span<uint64_t> frames) {
+    size_t count = 0;
+    bool playing = true;
+    while (count < frames.size() && playing) {
+      frames[count++] = static_cast<uint64_t>(position);
+      playing = advance_playback(position, rate, frame_count, loop);
+    }
+    // Playback stops on the last frame.
+    if (!playing && count < frames.size() && frames[count - 1] != frame_count - 1) {
+      frames[count++] = frame_count - 1;
+    }
+    return count;
+  }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <libcommon/vec.h>
+#include <span>
+
+constexpr uint32_t TRAJECTORY_VERSION = 1;
+constexpr char TRAJECTORY_MAGIC[8] = { 'S', 'P', 'H', 'T', 'R', 'A', 'J', '\0' };
+
+// Optional per-particle fields stored in each frame. Positions are always
+// stored.
+enum TrajectoryField : uint32_t {
+  TRAJ_VELOCITY = 1 << 0,
+  TRAJ_DENSITY  = 1 << 1,
+};
+
+// A trajectory file is a TrajectoryHeader followed by `frame_count` frames of
+// exactly `frame_size` bytes so any frame can be found without scanning.
+// Each frame is a FrameHeader followed by:
+//   uint16_t pos[3 * capacity]      quantized over [bounds_min, bounds_max]
+//   int16_t  vel[3 * capacity]      (TRAJ_VELOCITY) scaled by vel_scale
+//   uint16_t density[capacity]      (TRAJ_DENSITY) scaled by density_scale
+// Only the first `particle_count` entries of each array are meaningful.
+struct TrajectoryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t capacity;
+  uint32_t fields;
+  uint32_t interval;
+  float bounds_min;
+  float bounds_max;
+  uint64_t frame_size;
+  uint64_t frame_count;
+};
+
+struct FrameHeader {
+  uint64_t step;
+  uint32_t particle_count;
+  float vel_scale;
+  float density_scale;
+  uint32_t _padding;
+};
+
+namespace trajectory {
+  /**
+   * Size in bytes of one encoded frame.
+   */
+  uint64_t frame_size(uint32_t capacity, uint32_t fields);
+
+  /**
+   * Quantize one frame into `out` (which must hold `frame_size` bytes).
+   * `vel` and `density` may be empty when their fields are not recorded.
+   */
+  void encode_frame(
+    const TrajectoryHeader &header,
+    uint64_t step,
+    std::span<const Vec3> pos,
+    std::span<const Vec3> vel,
+    std::span<const float> density,
+    std::byte *out
+  );
+
+  /**
+   * Decode the positions of an encoded frame.
+   *
+   * @returns The number of particles in the frame.
+   */
+  uint32_t decode_positions(const TrajectoryHeader &header, const std::byte *frame, std::span<Vec3> pos);
+
+  /**
+   * Move a playback `position` (in frames) on by `rate` frames, as each
+   * drawn frame does. Past the last of `frame_count` frames it wraps around
+   * with `loop`, and otherwise stays on the last frame.
+   *
+   * @returns False once playback has reached the end without `loop`.
+   */
+  bool advance_playback(double &position, double rate, uint64_t frame_count, bool loop);
+
+  /**
+   * The frames playback shows from `position` on, in order and starting with
+   * the current one, up to `frames.size()` of them. Fractional rates repeat
+   * or skip frames exactly as `advance_playback` does.
+   *
+   * @returns The number of frames written.
+   */
+  size_t upcoming_frames(double position, double rate, uint64_t frame_count, bool loop, std::span<uint64_t> frames);
+}
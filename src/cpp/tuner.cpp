@@ -0,0 +1,212 @@
+#include "tuner.h"
+
+#include "neighbours.h"
+#include "particles.h"
+#include "procs.h"
+#include "sim_opts.h"
+#include "task_pool.h"
+#include "timer.h"
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <istream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+#endif
+
+namespace tuner {
+  constexpr const char *BUILD_NAME =
+#ifdef _OPENMP
+    "openmp";
+#else
+    "sequential";
+#endif
+
+  std::string _cache_key(const SimOpts &opts) {
+    // Reproducible runs tune a different set of fields.
+    return std::format("{}|{}{}|{}", cpu_model(), BUILD_NAME, opts.reproducible ? "-reproducible" : "", opts.particle_count);
+  }
+
+  double _time_config(const Particles &initial, const SimOpts &opts) {
+    Particles ps = initial;
+    Neighbours ns;
+    FrameTimer timer(TUNE_STEPS);
+
+    apply(opts);
+
+    // Untimed step sizes the grid and scratch buffers.
+    particles::step(ps, ns, opts);
+    for (uint32_t i = 0; i < TUNE_STEPS; i++) {
+      timer.record_start();
+      particles::step(ps, ns, opts);
+      timer.record_end();
+    }
+
+    return timer.average_millis();
+  }
+
+  void apply([[maybe_unused]] const SimOpts &opts) {
+#ifdef _OPENMP
+    // The thread count OpenMP started with (OMP_NUM_THREADS or the CPU
+    // count), which a zero `thread_count` goes back to.
+    static const int DEFAULT_THREADS = omp_get_max_threads();
+    omp_set_num_threads(opts.thread_count > 0 ? opts.thread_count : DEFAULT_THREADS);
+    task_pool().resize(omp_get_max_threads());
+
+    if (opts.pin_threads) {
+      cpu_set_t allowed;
+      CPU_ZERO(&allowed);
+      sched_getaffinity(0, sizeof(cpu_set_t), &allowed);
+
+      std::vector<int> cpus;
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+          cpus.push_back(cpu);
+        }
+      }
+
+      // OpenMP keeps its worker threads alive between parallel regions, so
+      // pinning them once here holds for every later pass.
+      #pragma omp parallel
+      {
+        size_t thread = omp_get_thread_num();
+        size_t threads = omp_get_num_threads();
+        cpu_set_t pinned;
+        CPU_ZERO(&pinned);
+        CPU_SET(cpus[(thread * cpus.size()) / threads], &pinned);
+        sched_setaffinity(0, sizeof(cpu_set_t), &pinned);
+      }
+
+      // The pool's worker 0 is the calling thread, already pinned above as
+      // OpenMP thread 0. The others follow the same spread.
+      std::vector<std::jthread> &workers = task_pool().worker_threads();
+      size_t threads = workers.size() + 1;
+      for (size_t thread = 1; thread < threads; thread++) {
+        cpu_set_t pinned;
+        CPU_ZERO(&pinned);
+        CPU_SET(cpus[(thread * cpus.size()) / threads], &pinned);
+        pthread_setaffinity_np(workers[thread - 1].native_handle(), sizeof(cpu_set_t), &pinned);
+      }
+    }
+#endif
+  }
+
+  std::string cpu_model() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    return cpu_model(cpuinfo);
+  }
+
+  std::string cpu_model(std::istream &cpuinfo) {
+    std::string line;
+
+    while (std::getline(cpuinfo, line)) {
+      if (line.starts_with("model name")) {
+        size_t start = line.find(':');
+        if (start != std::string::npos) {
+          // NOTE: A blank name would share cache entries with every other CPU.
+          start = line.find_first_not_of(" \t\r", start + 1);
+          size_t end = line.find_last_not_of(" \t\r");
+          return (start != std::string::npos) ? line.substr(start, end + 1 - start) : "unknown";
+        }
+      }
+    }
+
+    return "unknown";
+  }
+
+  std::optional<SimOpts> load_cached(const std::filesystem::path &cache_path, const SimOpts &opts) {
+    std::ifstream cache(cache_path);
+    std::string key = _cache_key(opts) + "|";
+    std::string line;
+    std::optional<SimOpts> result;
+
+    // Later entries override earlier ones for the same key.
+    while (std::getline(cache, line)) {
+      if (!line.starts_with(key)) {
+        continue;
+      }
+
+      SimOpts tuned = opts;
+      std::istringstream values(line.substr(key.size()));
+      if (values >> tuned.cell_ratio >> tuned.prune_stencil >> tuned.thread_count >> tuned.block_size
+          && tuned.cell_ratio >= 1 && tuned.cell_ratio <= MAX_CELL_RATIO) {
+        result = tuned;
+      }
+    }
+
+    return result;
+  }
+
+  void store_cached(const std::filesystem::path &cache_path, const SimOpts &opts) {
+    std::ofstream cache(cache_path, std::ios::app);
+    cache << std::format(
+      "{}|{} {} {} {}\n",
+      _cache_key(opts),
+      opts.cell_ratio,
+      opts.prune_stencil ? 1 : 0,
+      opts.thread_count,
+      opts.block_size
+    );
+  }
+
+  SimOpts tune(const Particles &initial, const SimOpts &opts) {
+    SimOpts best = opts;
+    double best_millis = _time_config(initial, best);
+
+    // Tune the grid first, then the parallel runtime on the best grid.
+    // NOTE: Pruning never removes cells from the ratio 1 stencil. The grid
+    //       sets the order neighbours are summed in, so reproducible runs
+    //       keep the one they were given.
+    for (uint32_t cell_ratio = 1; cell_ratio <= MAX_CELL_RATIO && !opts.reproducible; cell_ratio++) {
+      for (bool prune_stencil : { false, true }) {
+        if (cell_ratio == 1 && prune_stencil) {
+          continue;
+        }
+
+        SimOpts candidate = best;
+        candidate.cell_ratio = cell_ratio;
+        candidate.prune_stencil = prune_stencil;
+        double millis = _time_config(initial, candidate);
+        if (millis < best_millis) {
+          best = candidate;
+          best_millis = millis;
+        }
+      }
+    }
+
+#ifdef _OPENMP
+    std::vector<uint32_t> thread_counts;
+    uint32_t max_threads = omp_get_num_procs();
+    for (uint32_t threads = 1; threads < max_threads; threads *= 2) {
+      thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    SimOpts grid_best = best;
+    for (uint32_t thread_count : thread_counts) {
+      for (uint32_t block_size : { 0u, 8u, 32u, 128u }) {
+        SimOpts candidate = grid_best;
+        candidate.thread_count = thread_count;
+        candidate.block_size = block_size;
+        double millis = _time_config(initial, candidate);
+        if (millis < best_millis) {
+          best = candidate;
+          best_millis = millis;
+        }
+      }
+    }
+#endif
+
+    apply(best);
+    return best;
+  }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "particles.h"
+#include "sim_opts.h"
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <optional>
+#include <string>
+
+constexpr uint32_t TUNE_STEPS = 10; // frames per candidate configuration
+constexpr const char *TUNE_CACHE_FILE = "tune-cache.txt";
+
+namespace tuner {
+  /**
+   * Apply the thread count and thread pinning in `opts` to OpenMP and the
+   * task pool. A zero thread count restores OpenMP's default. Does nothing
+   * in the sequential build, which neither tunes nor honours either field.
+   */
+  void apply(const SimOpts &opts);
+
+  /**
+   * Model name of the CPU as reported by /proc/cpuinfo, or "unknown" when it
+   * is missing or blank.
+   */
+  std::string cpu_model();
+
+  /**
+   * `cpu_model` read from `cpuinfo`, in the format of /proc/cpuinfo.
+   */
+  std::string cpu_model(std::istream &cpuinfo);
+
+  /**
+   * Look up a previously tuned configuration for this CPU, build and
+   * particle count.
+   *
+   * @returns `opts` with the tuned fields replaced, or nothing on a cache miss.
+   */
+  std::optional<SimOpts> load_cached(const std::filesystem::path &cache_path, const SimOpts &opts);
+
+  /**
+   * Record the tuned fields of `opts` so later runs can skip tuning.
+   */
+  void store_cached(const std::filesystem::path &cache_path, const SimOpts &opts);
+
+  /**
+   * Micro-benchmark neighbour grid and force pass configurations, each
+   * stepping a copy of `initial`.
+   *
+   * @returns `opts` updated with the fastest configuration.
+   */
+  SimOpts tune(const Particles &initial, const SimOpts &opts);
+}
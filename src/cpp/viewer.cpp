@@ -0,0 +1,85 @@
+#include "viewer.h"
+
+#include "particles.h"
+#include "shared_frames.h"
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <libcommon/lib.h>
+#include <libcommon/matrix.h>
+#include <libcommon/vec.h>
+#include <memory>
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_gpu.h>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+Viewer::Viewer(std::filesystem::path exe_path)
+: exe_path{exe_path},
+  sdl_ctx{nullptr},
+  shown_frame{0} { }
+
+Viewer::~Viewer() {
+  if (sdl_ctx) {
+    libcommon::teardown(sdl_ctx);
+  }
+}
+
+void Viewer::open(const std::string &name) {
+  frames = std::make_unique<FrameSubscriber>(name);
+
+  // NOTE: The GPU pipeline works in groups of 64 particles.
+  uint32_t draw_count = ((frames->capacity() + 63) / 64) * 64;
+  auto res = libcommon::initialize_and_setup(exe_path.parent_path().c_str(), draw_count);
+  if (!res) {
+    throw std::runtime_error(std::format("{}", res.error()));
+  }
+  sdl_ctx = res.value();
+  sdl_ctx->uniforms.gen_point_sprites.particle_radius = frames->particle_radius();
+  sdl_ctx->uniforms.gen_point_sprites.model_view = libcommon::matrix::translate_z(2.0f)
+                                                 * libcommon::matrix::rotation_x(-20);
+}
+
+bool Viewer::copy_particles(libcommon::SDLCtx *sdl_ctx, SDL_GPUTransferBuffer *tbuf, const void *viewer_ctx) {
+  if (!viewer_ctx) {
+    return false;
+  }
+
+  Viewer *viewer = const_cast<Viewer*>(static_cast<const Viewer*>(viewer_ctx));
+  if (viewer->frames->latest() <= viewer->shown_frame) {
+    return false;
+  }
+
+  Vec4 *mapping = static_cast<Vec4*>(SDL_MapGPUTransferBuffer(sdl_ctx->device, tbuf, true));
+  if (!mapping) {
+    return false;
+  }
+
+  // Copy straight out of shared memory into the transfer buffer. A copy the
+  // solver overwrote part way is redone with its newer frame.
+  uint64_t frame = viewer->frames->read_latest(viewer->shown_frame, [&](std::span<const Vec3> pos, uint64_t) {
+    for (uint32_t i = 0; i < pos.size(); i++) {
+      mapping[i].copy_vec3(pos[i]);
+    }
+    for (uint32_t i = pos.size(); i < sdl_ctx->particle_count; i++) {
+      mapping[i].copy_vec3(HIDDEN_POSITION);
+    }
+  });
+
+  SDL_UnmapGPUTransferBuffer(sdl_ctx->device, tbuf);
+
+  if (frame == viewer->shown_frame) {
+    return false;
+  }
+  viewer->shown_frame = frame;
+  return true;
+}
+
+void Viewer::run_loop() {
+  bool run = true;
+  while (run) {
+    run = libcommon::update(sdl_ctx);
+    libcommon::draw(sdl_ctx, copy_particles, this);
+  }
+}
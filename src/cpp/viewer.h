@@ -0,0 +1,39 @@
+#pragma once
+
+#include "shared_frames.h"
+#include <cstdint>
+#include <filesystem>
+#include <libcommon/lib.h>
+#include <memory>
+#include <string>
+
+/**
+ * Draws the newest frame a running simulation publishes to shared memory
+ * (see SimOpts::shm_name), in its own process so rendering never holds up
+ * the solver. Frames published between two draws are skipped, and a draw
+ * with no new frame re-uses the particles already on the GPU.
+ */
+class Viewer {
+  std::filesystem::path exe_path;
+  libcommon::SDLCtx *sdl_ctx;
+  std::unique_ptr<FrameSubscriber> frames;
+  uint64_t shown_frame;
+
+  static bool copy_particles(libcommon::SDLCtx *sdl_ctx, SDL_GPUTransferBuffer *tbuf, const void *viewer_ctx);
+
+  public:
+    explicit Viewer(std::filesystem::path exe_path);
+    ~Viewer();
+
+    Viewer(const Viewer&) = delete;
+    Viewer& operator=(const Viewer&) = delete;
+
+    /**
+     * Attach to the frame ring `name` and set up rendering.
+     *
+     * @throws std::runtime_error if there is no usable ring by that name or
+     *         SDL setup fails.
+     */
+    void open(const std::string &name);
+    void run_loop();
+};
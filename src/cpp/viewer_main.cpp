@@ -0,0 +1,32 @@
+#include "viewer.h"
+#include <filesystem>
+#include <print>
+#include <stdexcept>
+#include <string>
+
+
+int main(int argc, const char **argv) {
+  std::filesystem::path exe_path(argv[0]);
+  std::string shm_name;
+
+  for (size_t i = 1; i < argc; i++) {
+    std::string_view arg(argv[i]);
+    shm_name = arg;
+  }
+
+  if (shm_name.empty()) {
+    std::println("Usage: {} <shared memory name, e.g. /sph>", exe_path.filename().string());
+    return 1;
+  }
+
+  Viewer viewer(exe_path);
+  try {
+    viewer.open(shm_name);
+    viewer.run_loop();
+  } catch(std::runtime_error err) {
+    std::println("Error: {}", err.what());
+    return 1;
+  }
+
+  return 0;
+}
@@ -3,6 +3,7 @@
 #include "lib.h"
 #include "SDL3/SDL_gpu.h"
 #include "vec.h"
+#include <algorithm>
 #include <cstdint>
 #include <utility>
 
@@ -10,8 +11,38 @@
 typedef uint32_t CError;
 typedef const Vec3 *const * vec3_list;
 
+// Where draw slots beyond the given particles are parked, outside the view.
+constexpr Vec3 PARKED_POSITION{1000.0f, 1000.0f, 1000.0f};
+
+// Positions to draw: either a list of pointers to positions (one per Pony
+// Particle, whose first field is its position) or packed positions.
+struct DrawList {
+  vec3_list list;
+  const Vec3 *packed;
+  uint32_t count;
+};
+
 bool copy_particles(libcommon::SDLCtx *ctx, SDL_GPUTransferBuffer *tbuf, const void *particles_obj) {
-  vec3_list particles = static_cast<vec3_list>(particles_obj);
+  const DrawList *particles = static_cast<const DrawList*>(particles_obj);
+  if (!particles) {
+    return false;
+  }
+
+  Vec4 *mapping = static_cast<Vec4*>(SDL_MapGPUTransferBuffer(ctx->device, tbuf, true));
+  if (!mapping) {
+    return false;
+  }
+
+  uint32_t count = std::min(particles->count, ctx->particle_count);
+  for (uint32_t i = 0; i < count; i++) {
+    mapping[i].copy_vec3(particles->list ? *particles->list[i] : particles->packed[i]);
+  }
+  for (uint32_t i = count; i < ctx->particle_count; i++) {
+    mapping[i].copy_vec3(PARKED_POSITION);
+  }
+
+  SDL_UnmapGPUTransferBuffer(ctx->device, tbuf);
+
   return true;
 }
 
@@ -39,9 +70,18 @@ extern "C" {
     return libcommon::update(ctx) ? 1 : 0;
   }
 
-  void c_draw(void *ctx_ptr, vec3_list positions) {
+  void c_draw(void *ctx_ptr, vec3_list positions, uint32_t count) {
+    if (!ctx_ptr) { return; }
+    libcommon::SDLCtx *ctx = static_cast<libcommon::SDLCtx*>(ctx_ptr);
+    DrawList particles{ .list = positions, .packed = nullptr, .count = count };
+    libcommon::draw(ctx, copy_particles, &particles);
+  }
+
+  // Draw `count` packed x, y, z float triples, e.g. from sph_positions.
+  void c_draw_positions(void *ctx_ptr, const float *positions, uint32_t count) {
     if (!ctx_ptr) { return; }
     libcommon::SDLCtx *ctx = static_cast<libcommon::SDLCtx*>(ctx_ptr);
-    libcommon::draw(ctx, copy_particles, static_cast<const void*>(positions));
+    DrawList particles{ .list = nullptr, .packed = reinterpret_cast<const Vec3*>(positions), .count = count };
+    libcommon::draw(ctx, copy_particles, &particles);
   }
 };
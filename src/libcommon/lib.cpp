@@ -31,6 +31,7 @@ namespace libcommon {
     return new SDLCtx{
       .exe_dir = exe_dir,
       .particle_count = particle_count,
+      .draw_count = particle_count,
     };
   }
 
@@ -497,7 +498,7 @@ namespace libcommon {
       SDL_GPUBufferRegion dest = {
         .buffer = ctx->bufs.point_sprites.b,
         .offset = 0,
-        .size = static_cast<uint32_t>(sizeof(Vec4) * ctx->particle_count),
+        .size = static_cast<uint32_t>(sizeof(Vec4) * ctx->draw_count),
       };
       SDL_GPUCopyPass *upload_particles_pass = SDL_BeginGPUCopyPass(cmds);
       SDL_UploadToGPUBuffer(upload_particles_pass, &source, &dest, true);
@@ -524,7 +525,7 @@ namespace libcommon {
       SDL_BindGPUComputeStorageBuffers(gen_point_sprites_pass, 0, &(ctx->bufs.point_sprites.b), 1);
       SDL_PushGPUComputeUniformData(cmds, 0, &(ctx->uniforms.gen_point_sprites), sizeof(ctx->uniforms.gen_point_sprites));
       // NOTE: Hard-coded workgroup size of 64 in the x dimension.
-      SDL_DispatchGPUCompute(gen_point_sprites_pass, ctx->particle_count / 64, 1, 1);
+      SDL_DispatchGPUCompute(gen_point_sprites_pass, ctx->draw_count / 64, 1, 1);
       SDL_EndGPUComputePass(gen_point_sprites_pass);
     }
 
@@ -554,7 +555,7 @@ namespace libcommon {
           .offset = 0,
         },
       };
-      uint32_t num_vertices = ctx->particle_count * 6;
+      uint32_t num_vertices = ctx->draw_count * 6;
       SDL_GPURenderPass *render_pass = SDL_BeginGPURenderPass(cmds, &cti, 1, &dsti);
       SDL_BindGPUGraphicsPipeline(render_pass, ctx->pipelines.pass1);
       SDL_BindGPUVertexBuffers(render_pass, 0, vertex_buffer_bindings, 2);
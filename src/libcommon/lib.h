@@ -68,6 +68,9 @@ namespace libcommon {
     uint32_t window_width = 0;
     uint32_t window_height = 0;
     uint32_t particle_count = 0;
+    // Particles uploaded and drawn, a multiple of 64 up to `particle_count`.
+    // Copy callbacks may lower it each frame to the live particle count.
+    uint32_t draw_count = 0;
   };
 
   struct SDLError {
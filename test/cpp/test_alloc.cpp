@@ -0,0 +1,53 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <cpp/alloc.h>
+#include <cstdint>
+#include <cstring>
+#include <libcommon/vec.h>
+
+static bool aligned_to(const void *ptr, size_t alignment) {
+  return reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+}
+
+TEST_CASE("Particle Arrays Are Aligned", "[alloc]") {
+  PageMode mode = GENERATE(PageMode::Default, PageMode::Transparent, PageMode::Explicit);
+  alloc::set_page_mode(mode);
+
+  SECTION("Small arrays on cache lines") {
+    for (size_t bytes : { size_t{1}, size_t{12}, size_t{4096}, HUGE_PAGE_SIZE - 1 }) {
+      void *ptr = alloc::allocate(bytes);
+      INFO("Bytes: " << bytes);
+      REQUIRE(aligned_to(ptr, ALLOC_ALIGNMENT));
+      std::memset(ptr, 1, bytes);
+      alloc::deallocate(ptr, bytes);
+    }
+  }
+
+  // Explicit huge pages are rarely reserved, so this mostly covers the
+  // fallback to a regular mapping.
+  SECTION("Large arrays on huge pages") {
+    for (size_t bytes : { HUGE_PAGE_SIZE, HUGE_PAGE_SIZE + 1, 3 * HUGE_PAGE_SIZE + 4096 }) {
+      void *ptr = alloc::allocate(bytes);
+      INFO("Bytes: " << bytes);
+      REQUIRE(aligned_to(ptr, HUGE_PAGE_SIZE));
+      std::memset(ptr, 1, bytes);
+      alloc::deallocate(ptr, bytes);
+    }
+  }
+
+  SECTION("Growing a ParticleArray keeps its contents") {
+    ParticleArray<Vec3> values;
+    for (uint32_t i = 0; i < 300000; i++) {
+      values.push_back(Vec3{ static_cast<float>(i), 0, 0 });
+    }
+    REQUIRE(values.size() * sizeof(Vec3) >= HUGE_PAGE_SIZE);
+    REQUIRE(aligned_to(values.data(), HUGE_PAGE_SIZE));
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < values.size(); i++) {
+      mismatches += (values[i].x() != static_cast<float>(i)) ? 1 : 0;
+    }
+    REQUIRE(mismatches == 0);
+  }
+
+  alloc::set_page_mode(PageMode::Default);
+}
@@ -0,0 +1,96 @@
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <cpp/arena.h>
+#include <cpp/neighbours.h>
+#include <cpp/particles.h>
+#include <cpp/procs.h>
+#include <cpp/sim_opts.h>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Count every heap allocation made while `counting` is set.
+static std::atomic<bool> counting = false;
+static std::atomic<uint64_t> allocations = 0;
+
+static void *counted_alloc(size_t size, size_t alignment) {
+  if (counting) {
+    allocations += 1;
+  }
+  size = (size + alignment - 1) & ~(alignment - 1);
+  void *ptr = std::aligned_alloc(alignment, size ? size : alignment);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void *operator new(size_t size) { return counted_alloc(size, alignof(std::max_align_t)); }
+void *operator new[](size_t size) { return counted_alloc(size, alignof(std::max_align_t)); }
+void *operator new(size_t size, std::align_val_t align) { return counted_alloc(size, static_cast<size_t>(align)); }
+void *operator new[](size_t size, std::align_val_t align) { return counted_alloc(size, static_cast<size_t>(align)); }
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+TEST_CASE("Arena Rewind", "[arena]") {
+  FrameArena arena;
+
+  size_t start = arena.mark();
+  std::span<float> first = arena.alloc<float>(100);
+  std::span<uint32_t> second = arena.alloc<uint32_t>(3);
+
+  REQUIRE(reinterpret_cast<uintptr_t>(first.data()) % ARENA_ALIGNMENT == 0);
+  REQUIRE(reinterpret_cast<uintptr_t>(second.data()) % ARENA_ALIGNMENT == 0);
+  REQUIRE(arena.bytes_in_use() > 0);
+
+  arena.rewind(start);
+  REQUIRE(arena.bytes_in_use() == 0);
+
+  // Once grown to the peak, the same requests come from the arena block.
+  allocations = 0;
+  counting = true;
+  {
+    ArenaScope scope(arena);
+    arena.alloc<float>(100);
+    arena.alloc<uint32_t>(3);
+  }
+  counting = false;
+  REQUIRE(allocations == 0);
+  REQUIRE(arena.bytes_in_use() == 0);
+}
+
+TEST_CASE("Steady State Steps Do Not Allocate", "[arena]") {
+  SimOpts sim_opts{
+    .bench_mode = false,
+    .particle_count = 1024,
+    .particle_radius = PARTICLE_RADIUS,
+    .gas_constant = GAS_CONSTANT,
+    .rest_density = REST_DENSITY,
+    .support = SUPPORT,
+    .viscosity_constant = VISCOSITY_CONSTANT,
+  };
+  Particles ps;
+  Neighbours ns;
+  ps.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+
+  // Warm up: sizes the grid and lets the arenas grow to their peak.
+  for (int i = 0; i < 3; i++) {
+    particles::step(ps, ns, sim_opts);
+  }
+
+  allocations = 0;
+  counting = true;
+  for (int i = 0; i < 10; i++) {
+    particles::step(ps, ns, sim_opts);
+  }
+  counting = false;
+
+  REQUIRE(allocations == 0);
+  REQUIRE(frame_arena().bytes_in_use() == 0);
+}
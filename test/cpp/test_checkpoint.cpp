@@ -0,0 +1,113 @@
+#include "../generators.h"
+#include "../misc_declarations.h" // Includes functions required by Catch2 to work on custom types.
+#include <bit>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <catch2/matchers/catch_matchers.hpp>
+#include <catch2/matchers/catch_matchers_vector.hpp>
+#include <cpp/checkpoint.h>
+#include <cpp/particles.h>
+#include <cpp/sim_opts.h>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <utility>
+
+TEST_CASE("Checkpoint Round Trip", "[checkpoint]") {
+  std::filesystem::path path = std::filesystem::temp_directory_path() / "sph-test-checkpoint.bin";
+  SimOpts saved_opts{
+    .bench_mode = false,
+    .particle_count = 128,
+    .particle_radius = PARTICLE_RADIUS,
+    .gas_constant = 0.5f,
+    .rest_density = 250.0f,
+    .support = SUPPORT,
+    .viscosity_constant = 0.2f,
+    .time_step = 0.02f,
+    .cell_ratio = 2,
+    .prune_stencil = true,
+  };
+  auto vec_gen = random_Vec3(-1.0f, 1.0f);
+  Particles ps;
+  ps.reset(saved_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+  for (size_t i = 0; i < ps.size(); i++) {
+    ps.vel[i] = vec_gen.get();
+    vec_gen.next();
+    ps.density[i] = static_cast<float>(i);
+    ps.pressure[i] = -static_cast<float>(i);
+  }
+
+  REQUIRE(checkpoint::save(path, ps, saved_opts).has_value());
+
+  SECTION("Restores particles and parameters") {
+    SimOpts opts{ .bench_mode = true, .particle_count = 64 };
+    Particles loaded;
+
+    REQUIRE(checkpoint::load(path, loaded, opts).has_value());
+    REQUIRE(loaded.size() == ps.size());
+    REQUIRE(loaded.pos == ps.pos);
+    REQUIRE(loaded.vel == ps.vel);
+    REQUIRE(loaded.density == ps.density);
+    REQUIRE(loaded.pressure == ps.pressure);
+    REQUIRE(opts.bench_mode);
+    REQUIRE(opts.particle_count == saved_opts.particle_count);
+    REQUIRE(opts.gas_constant == saved_opts.gas_constant);
+    REQUIRE(opts.rest_density == saved_opts.rest_density);
+    REQUIRE(opts.viscosity_constant == saved_opts.viscosity_constant);
+    REQUIRE(opts.time_step == saved_opts.time_step);
+    REQUIRE(opts.cell_ratio == saved_opts.cell_ratio);
+    REQUIRE(opts.prune_stencil == saved_opts.prune_stencil);
+  }
+
+  SECTION("Rejects truncated files") {
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    SimOpts opts{};
+    Particles loaded;
+
+    auto res = checkpoint::load(path, loaded, opts);
+    REQUIRE(!res.has_value());
+    REQUIRE(res.error() == checkpoint::CheckpointError::Truncated);
+  }
+
+  SECTION("Rejects offsets past the end") {
+    // An offset this large wraps around when the array size is added.
+    uint64_t pos_offset = UINT64_MAX - 64;
+    {
+      std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+      file.seekp(48); // Header::pos_offset
+      file.write(reinterpret_cast<const char*>(&pos_offset), sizeof(pos_offset));
+    }
+    SimOpts opts{};
+    Particles loaded;
+
+    auto res = checkpoint::load(path, loaded, opts);
+    REQUIRE(!res.has_value());
+    REQUIRE(res.error() == checkpoint::CheckpointError::Truncated);
+  }
+
+  SECTION("Rejects invalid parameters") {
+    // Header::cell_ratio, Header::support and Header::time_step.
+    auto [offset, value] = GENERATE(
+      std::pair<std::streamoff, uint32_t>{ 36, 0 },
+      std::pair<std::streamoff, uint32_t>{ 36, MAX_CELL_RATIO + 1 },
+      std::pair<std::streamoff, uint32_t>{ 28, std::bit_cast<uint32_t>(0.0f) },
+      std::pair<std::streamoff, uint32_t>{ 28, std::bit_cast<uint32_t>(-SUPPORT) },
+      std::pair<std::streamoff, uint32_t>{ 44, std::bit_cast<uint32_t>(std::numeric_limits<float>::quiet_NaN()) }
+    );
+    {
+      std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+      file.seekp(offset);
+      file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    SimOpts opts{ .particle_count = 64 };
+    Particles loaded;
+
+    auto res = checkpoint::load(path, loaded, opts);
+    REQUIRE(!res.has_value());
+    REQUIRE(res.error() == checkpoint::CheckpointError::BadParameters);
+    REQUIRE(loaded.size() == 0);
+    REQUIRE(opts.particle_count == 64);
+  }
+
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,154 @@
+#include <catch2/catch_session.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cpp/domain.h>
+#include <cpp/neighbours.h>
+#include <cpp/particles.h>
+#include <cpp/procs.h>
+#include <cpp/sim_opts.h>
+#include <mpi.h>
+#include <vector>
+
+// Run under `mpirun -np <ranks>`. Every rank runs every test case.
+
+constexpr uint32_t PARTICLE_COUNT = 2048;
+
+static SimOpts make_opts() {
+  return SimOpts{
+    .bench_mode = false,
+    .particle_count = PARTICLE_COUNT,
+    .particle_radius = PARTICLE_RADIUS,
+    .gas_constant = GAS_CONSTANT,
+    .rest_density = REST_DENSITY,
+    .support = SUPPORT,
+    .viscosity_constant = VISCOSITY_CONSTANT,
+  };
+}
+
+// Order independent sums, since ranks hold particles in a different order
+// than a single process does.
+static double kinetic_energy(const Particles &ps) {
+  double sum = 0;
+  for (size_t i = 0; i < ps.size(); i++) {
+    sum += ps.vel[i].length_squared() / 2;
+  }
+  return sum;
+}
+
+static Vec3 mean_position(const Particles &ps) {
+  double x = 0, y = 0, z = 0;
+  for (size_t i = 0; i < ps.size(); i++) {
+    x += ps.pos[i].x();
+    y += ps.pos[i].y();
+    z += ps.pos[i].z();
+  }
+  return Vec3{ float(x / ps.size()), float(y / ps.size()), float(z / ps.size()) };
+}
+
+TEST_CASE("Distributed Step Matches Single Process", "[domain]") {
+  SimOpts sim_opts = make_opts();
+  Particles all;
+  all.reset(PARTICLE_COUNT, X_BOUNDS.x(), X_BOUNDS.y());
+
+  Particles expected = all;
+  Neighbours ns;
+  particles::step(expected, ns, sim_opts);
+
+  Domain domain(MPI_COMM_WORLD, sim_opts);
+  domain.distribute(all);
+  domain.step();
+
+  // Only summation order differs after one step, so any particle missing a
+  // ghost neighbour (or a ghost with the wrong density) shows up here.
+  double local = kinetic_energy(domain.particles());
+  double total = 0;
+  MPI_Allreduce(&local, &total, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  REQUIRE(std::abs(total - kinetic_energy(expected)) <= 1e-5 * kinetic_energy(expected));
+}
+
+TEST_CASE("Distributed Steps Conserve Particles", "[domain]") {
+  SimOpts sim_opts = make_opts();
+  Particles all;
+  all.reset(PARTICLE_COUNT, X_BOUNDS.x(), X_BOUNDS.y());
+
+  Particles expected = all;
+  Neighbours ns;
+  Domain domain(MPI_COMM_WORLD, sim_opts);
+  domain.distribute(all);
+  for (int i = 0; i < 20; i++) {
+    particles::step(expected, ns, sim_opts);
+    domain.step();
+    REQUIRE(domain.global_count() == PARTICLE_COUNT);
+  }
+
+  Particles gathered;
+  domain.gather(gathered);
+  if (domain.rank_index() == 0) {
+    REQUIRE(gathered.size() == PARTICLE_COUNT);
+
+    Vec3 expected_mean = mean_position(expected);
+    Vec3 actual_mean = mean_position(gathered);
+    REQUIRE((actual_mean - expected_mean).length() < 1e-3f);
+  }
+}
+
+TEST_CASE("Distributed Steps Reject Options They Do Not Run", "[domain]") {
+  SimOpts sim_opts = make_opts();
+  sim_opts.time_levels = 2;
+  REQUIRE_THROWS(Domain(MPI_COMM_WORLD, sim_opts));
+
+  sim_opts = make_opts();
+  sim_opts.sleep_cells = true;
+  REQUIRE_THROWS(Domain(MPI_COMM_WORLD, sim_opts));
+
+  sim_opts = make_opts();
+  sim_opts.pressure_solver = PressureSolver::Pcisph;
+  REQUIRE_THROWS(Domain(MPI_COMM_WORLD, sim_opts));
+}
+
+// Positions, velocities, densities and pressures as bit patterns, in a
+// canonical order.
+static std::vector<std::array<uint32_t, 8>> canonical_state(const Particles &ps) {
+  std::vector<std::array<uint32_t, 8>> state;
+  for (size_t i = 0; i < ps.size(); i++) {
+    state.push_back({
+      std::bit_cast<uint32_t>(ps.pos[i].x()), std::bit_cast<uint32_t>(ps.pos[i].y()), std::bit_cast<uint32_t>(ps.pos[i].z()),
+      std::bit_cast<uint32_t>(ps.vel[i].x()), std::bit_cast<uint32_t>(ps.vel[i].y()), std::bit_cast<uint32_t>(ps.vel[i].z()),
+      std::bit_cast<uint32_t>(ps.density[i]), std::bit_cast<uint32_t>(ps.pressure[i]),
+    });
+  }
+  std::sort(state.begin(), state.end());
+  return state;
+}
+
+TEST_CASE("Reproducible Distributed Steps Match Single Process Bitwise", "[domain]") {
+  SimOpts sim_opts = make_opts();
+  sim_opts.reproducible = true;
+  Particles all;
+  all.reset(PARTICLE_COUNT, X_BOUNDS.x(), X_BOUNDS.y());
+
+  Particles expected = all;
+  Neighbours ns;
+  Domain domain(MPI_COMM_WORLD, sim_opts);
+  domain.distribute(all);
+  for (int i = 0; i < 20; i++) {
+    particles::step(expected, ns, sim_opts);
+    domain.step();
+  }
+
+  Particles gathered;
+  domain.gather(gathered);
+  if (domain.rank_index() == 0) {
+    REQUIRE(canonical_state(gathered) == canonical_state(expected));
+  }
+}
+
+int main(int argc, char **argv) {
+  MPI_Init(&argc, &argv);
+  int result = Catch::Session().run(argc, argv);
+  MPI_Finalize();
+  return result;
+}
@@ -0,0 +1,64 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <cpp/backend.h>
+#include <cpp/ensemble.h>
+#include <cpp/neighbours.h>
+#include <cpp/particles.h>
+#include <cpp/procs.h>
+#include <cpp/sim_opts.h>
+#include <cpp/task_pool.h>
+#include <cstring>
+#include <vector>
+
+constexpr uint32_t ENSEMBLE_STEPS = 10;
+
+static SimOpts member_opts(float gas_constant) {
+  return SimOpts{
+    .bench_mode = true,
+    .particle_count = 512,
+    .particle_radius = PARTICLE_RADIUS,
+    .gas_constant = gas_constant,
+    .rest_density = REST_DENSITY,
+    .support = SUPPORT,
+    .viscosity_constant = VISCOSITY_CONSTANT,
+    .backend = exec::Backend::ThreadPool,
+  };
+}
+
+TEST_CASE("Ensemble Members Match Single Runs", "[ensemble]") {
+  // Fewer workers than members steps members as pool tasks, more steps them
+  // in turn on the whole pool.
+  auto workers = GENERATE(1, 2, 4);
+  std::vector<float> gas_constants{0.1f, 0.3f, 0.5f};
+
+  task_pool().resize(workers);
+  Ensemble ensemble;
+  for (float gas_constant : gas_constants) {
+    ensemble.add(member_opts(gas_constant));
+  }
+  ensemble.step(ENSEMBLE_STEPS / 2);
+  ensemble.step(ENSEMBLE_STEPS / 2);
+  task_pool().resize(1);
+
+  INFO("Workers: " << workers);
+  REQUIRE(ensemble.size() == gas_constants.size());
+  for (size_t m = 0; m < gas_constants.size(); m++) {
+    SimOpts opts = member_opts(gas_constants[m]);
+    Particles expected;
+    Neighbours ns;
+    expected.reset(opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+    for (uint32_t step = 0; step < ENSEMBLE_STEPS; step++) {
+      particles::step(expected, ns, opts);
+    }
+
+    const Particles &actual = ensemble.particles(m);
+    size_t count = expected.size();
+    REQUIRE(actual.size() == count);
+    REQUIRE(std::memcmp(actual.pos.data(), expected.pos.data(), count * sizeof(Vec3)) == 0);
+    REQUIRE(std::memcmp(actual.vel.data(), expected.vel.data(), count * sizeof(Vec3)) == 0);
+
+    MemberResult result = ensemble.result(m);
+    REQUIRE(result.gas_constant == gas_constants[m]);
+    REQUIRE(result.steps == ENSEMBLE_STEPS);
+  }
+}
@@ -0,0 +1,121 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <cpp/backend.h>
+#include <cpp/neighbours.h>
+#include <cpp/particles.h>
+#include <cpp/procs.h>
+#include <cpp/sim_opts.h>
+#include <cpp/task_pool.h>
+#include <cstring>
+#include <random>
+#include <utility>
+
+constexpr int STEPS = 20;
+
+static Particles run_steps(exec::Backend backend, bool task_graph = false) {
+  SimOpts sim_opts{
+    .bench_mode = false,
+    .particle_count = 2048,
+    .particle_radius = PARTICLE_RADIUS,
+    .gas_constant = GAS_CONSTANT,
+    .rest_density = REST_DENSITY,
+    .support = SUPPORT,
+    .viscosity_constant = VISCOSITY_CONSTANT,
+    .backend = backend,
+    .task_graph = task_graph,
+  };
+  Particles ps;
+  Neighbours ns;
+  ps.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+
+  for (int i = 0; i < STEPS; i++) {
+    particles::step(ps, ns, sim_opts);
+  }
+
+  return ps;
+}
+
+TEST_CASE("Backends Agree", "[exec]") {
+  auto backend = GENERATE(
+    exec::Backend::OpenMP,
+    exec::Backend::StdPar,
+    exec::Backend::ThreadPool
+  );
+
+  // Several workers so the pool actually splits and steals work.
+  task_pool().resize(4);
+  Particles expected = run_steps(exec::Backend::Serial);
+  Particles actual = run_steps(backend);
+  task_pool().resize(1);
+
+  INFO("Backend: " << exec::backend_name(backend));
+  size_t count = expected.size();
+  REQUIRE(actual.size() == count);
+  REQUIRE(std::memcmp(actual.pos.data(), expected.pos.data(), count * sizeof(Vec3)) == 0);
+  REQUIRE(std::memcmp(actual.vel.data(), expected.vel.data(), count * sizeof(Vec3)) == 0);
+  REQUIRE(std::memcmp(actual.density.data(), expected.density.data(), count * sizeof(float)) == 0);
+}
+
+TEST_CASE("Task Graph Matches Passes", "[exec]") {
+  auto workers = GENERATE(1, 4);
+
+  task_pool().resize(workers);
+  Particles expected = run_steps(exec::Backend::Serial);
+  Particles actual = run_steps(exec::Backend::Serial, true);
+  task_pool().resize(1);
+
+  size_t count = expected.size();
+  REQUIRE(actual.size() == count);
+  REQUIRE(std::memcmp(actual.pos.data(), expected.pos.data(), count * sizeof(Vec3)) == 0);
+  REQUIRE(std::memcmp(actual.vel.data(), expected.vel.data(), count * sizeof(Vec3)) == 0);
+  REQUIRE(std::memcmp(actual.density.data(), expected.density.data(), count * sizeof(float)) == 0);
+}
+
+TEST_CASE("Reproducible Mode Ignores Particle Order", "[exec]") {
+  SimOpts sim_opts{
+    .bench_mode = false,
+    .particle_count = 2048,
+    .particle_radius = PARTICLE_RADIUS,
+    .gas_constant = GAS_CONSTANT,
+    .rest_density = REST_DENSITY,
+    .support = SUPPORT,
+    .viscosity_constant = VISCOSITY_CONSTANT,
+    .reproducible = true,
+  };
+  Particles expected;
+  expected.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+
+  // Same particles, different order, stepped on more threads.
+  Particles actual = expected;
+  std::mt19937 rng(4060);
+  for (size_t i = actual.size() - 1; i > 0; i--) {
+    size_t j = std::uniform_int_distribution<size_t>(0, i)(rng);
+    std::swap(actual.pos[i], actual.pos[j]);
+    std::swap(actual.vel[i], actual.vel[j]);
+  }
+
+  SimOpts serial_opts = sim_opts;
+  SimOpts pool_opts = sim_opts;
+  serial_opts.backend = exec::Backend::Serial;
+  pool_opts.backend = exec::Backend::ThreadPool;
+
+  Neighbours expected_ns, actual_ns;
+  task_pool().resize(4);
+  for (int i = 0; i < STEPS; i++) {
+    particles::step(expected, expected_ns, serial_opts);
+    particles::step(actual, actual_ns, pool_opts);
+  }
+  task_pool().resize(1);
+
+  // Each step's sort leaves both in the same (canonical) order.
+  size_t count = expected.size();
+  REQUIRE(std::memcmp(actual.pos.data(), expected.pos.data(), count * sizeof(Vec3)) == 0);
+  REQUIRE(std::memcmp(actual.vel.data(), expected.vel.data(), count * sizeof(Vec3)) == 0);
+}
+
+TEST_CASE("Backend Names", "[exec]") {
+  for (auto backend : { exec::Backend::Serial, exec::Backend::OpenMP, exec::Backend::StdPar, exec::Backend::ThreadPool }) {
+    REQUIRE(exec::parse_backend(exec::backend_name(backend)) == backend);
+  }
+  REQUIRE_FALSE(exec::parse_backend("gpu"));
+}
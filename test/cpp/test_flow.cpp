@@ -0,0 +1,166 @@
+#include "../generators.h"
+#include "../misc_declarations.h"
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <catch2/matchers/catch_matchers.hpp>
+#include <catch2/matchers/catch_matchers_vector.hpp>
+#include <cpp/checkpoint.h>
+#include <cpp/flow.h>
+#include <cpp/neighbours.h>
+#include <cpp/particles.h>
+#include <cpp/procs.h>
+#include <cpp/sim_opts.h>
+#include <filesystem>
+#include <vector>
+
+static SimOpts flow_opts(uint32_t particle_count, uint32_t particle_capacity) {
+  return SimOpts{
+    .bench_mode = false,
+    .particle_count = particle_count,
+    .particle_radius = PARTICLE_RADIUS,
+    .gas_constant = GAS_CONSTANT,
+    .rest_density = REST_DENSITY,
+    .support = SUPPORT,
+    .viscosity_constant = VISCOSITY_CONSTANT,
+    .particle_capacity = particle_capacity,
+  };
+}
+
+TEST_CASE("Emitters Fill Up To Capacity", "[flow]") {
+  SimOpts sim_opts = flow_opts(64, 128);
+  Emitter inlet = flow::fountain_inlet(40);
+  sim_opts.emitters.push_back(inlet);
+  Particles ps;
+  ps.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+
+  REQUIRE(flow::emit(ps, sim_opts, 0) == 40);
+  REQUIRE(flow::emit(ps, sim_opts, 1) == 24);
+  REQUIRE(flow::emit(ps, sim_opts, 2) == 0);
+  REQUIRE(ps.size() == flow::capacity(sim_opts));
+
+  for (size_t i = sim_opts.particle_count; i < ps.size(); i++) {
+    Vec3 offset = ps.pos[i] - inlet.centre;
+    INFO("Particle: " << i);
+    REQUIRE(offset.y() == 0);
+    REQUIRE(offset.length() <= inlet.radius);
+    REQUIRE(ps.vel[i] == inlet.velocity);
+  }
+
+  SECTION("Repeatable for the same step") {
+    Particles again;
+    again.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+    flow::emit(again, sim_opts, 0);
+    for (size_t i = 0; i < again.size(); i++) {
+      REQUIRE(again.pos[i] == ps.pos[i]);
+    }
+  }
+}
+
+TEST_CASE("Growth Doubles Storage", "[flow]") {
+  Particles ps;
+  uint32_t reallocations = 0;
+  const Vec3 *storage = ps.pos.data();
+
+  for (int i = 0; i < 4096; i++) {
+    ps.grow(3);
+    if (ps.pos.data() != storage) {
+      reallocations += 1;
+      storage = ps.pos.data();
+    }
+  }
+
+  REQUIRE(ps.size() == 3 * 4096);
+  REQUIRE(ps.density.size() == ps.size());
+  REQUIRE(reallocations <= 14);
+}
+
+TEST_CASE("Sinks Drop Particles In The Sort", "[flow]") {
+  SimOpts sim_opts = flow_opts(2048, 0);
+  sim_opts.reproducible = GENERATE(false, true);
+  sim_opts.sinks.push_back(Sink{ .low = Vec3{-1, -1, -1}, .high = Vec3{0, 0, 0} });
+  sim_opts.sinks.push_back(flow::corner_drain());
+  auto gen = random_Vec3(-1.0f, 1.0f);
+  Particles ps;
+  Neighbours ns;
+  ps.resize(sim_opts.particle_count);
+
+  std::vector<Vec3> survivors;
+  for (size_t i = 0; i < ps.size(); i++) {
+    ps.pos[i] = gen.get();
+    ps.vel[i] = Vec3{0, 0, 0};
+    gen.next();
+    if (!flow::in_sink(ps.pos[i], sim_opts.sinks)) {
+      survivors.push_back(ps.pos[i]);
+    }
+  }
+  REQUIRE(survivors.size() < ps.size());
+
+  ns.process(ps, sim_opts);
+
+  REQUIRE(ps.size() == survivors.size());
+  REQUIRE(ps.vel.size() == survivors.size());
+  std::vector<Vec3> kept(ps.pos.begin(), ps.pos.end());
+  REQUIRE_THAT(kept, Catch::Matchers::UnorderedEquals(survivors));
+
+  uint32_t grid_width = Neighbours::grid_width_for(sim_opts);
+  REQUIRE(ns.cell_start(grid_width * grid_width * grid_width) == ps.size());
+  for (size_t i = 1; i < ps.size(); i++) {
+    REQUIRE(ns.cell_index(ps.pos[i - 1], grid_width) <= ns.cell_index(ps.pos[i], grid_width));
+  }
+}
+
+TEST_CASE("Steady Flow Never Reallocates", "[flow]") {
+  SimOpts sim_opts = flow_opts(1024, 2048);
+  sim_opts.emitters.push_back(flow::fountain_inlet(16));
+  sim_opts.sinks.push_back(flow::corner_drain());
+  sim_opts.fountain_force = false;
+  Particles ps;
+  Neighbours ns;
+  ps.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+  ps.reserve(flow::capacity(sim_opts));
+  const Vec3 *storage = ps.pos.data();
+
+  for (uint64_t step = 0; step < 120; step++) {
+    flow::emit(ps, sim_opts, step);
+    particles::step(ps, ns, sim_opts);
+    REQUIRE(ps.size() <= flow::capacity(sim_opts));
+  }
+
+  REQUIRE(ps.pos.data() == storage);
+  REQUIRE(ps.size() > sim_opts.particle_count);
+
+  // Particles that moved into a sink during the last step leave in the next
+  // sort.
+  ns.process(ps, sim_opts);
+  for (size_t i = 0; i < ps.size(); i++) {
+    INFO("Particle: " << i);
+    REQUIRE(std::isfinite(ps.pos[i].x()));
+    REQUIRE_FALSE(flow::in_sink(ps.pos[i], sim_opts.sinks));
+  }
+}
+
+TEST_CASE("Drained Checkpoints Load With Whole Workgroups", "[flow]") {
+  std::filesystem::path path = std::filesystem::temp_directory_path() / "sph-test-drained.bin";
+  SimOpts sim_opts = flow_opts(2048, 0);
+  sim_opts.sinks.push_back(Sink{ .low = Vec3{-1, -1, -1}, .high = Vec3{0, 1, 1} });
+  sim_opts.fountain_force = false;
+  Particles ps;
+  Neighbours ns;
+  ps.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+  particles::step(ps, ns, sim_opts);
+  REQUIRE(ps.size() % 64 != 0);
+
+  REQUIRE(checkpoint::save(path, ps, sim_opts).has_value());
+  SimOpts opts{};
+  Particles loaded;
+  REQUIRE(checkpoint::load(path, loaded, opts).has_value());
+  std::filesystem::remove(path);
+
+  REQUIRE(loaded.size() == ps.size());
+  REQUIRE(loaded.pos == ps.pos);
+  REQUIRE(opts.particle_count == ps.size());
+  REQUIRE(flow::capacity(opts) % 64 == 0);
+  REQUIRE(flow::capacity(opts) >= opts.particle_count);
+  REQUIRE(flow::capacity(opts) < opts.particle_count + 64);
+}
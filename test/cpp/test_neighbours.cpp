@@ -7,7 +7,9 @@
 #include <cmath>
 #include <cpp/neighbours.h>
 #include <cpp/particles.h>
+#include <cpp/procs.h>
 #include <cpp/sim_opts.h>
+#include <tuple>
 
 TEST_CASE("Cell Index", "[sort]") {
   uint32_t grid_width = std::floorf((X_BOUNDS.y() - X_BOUNDS.x()) / SUPPORT);
@@ -66,6 +68,86 @@ TEST_CASE("Cell Index", "[sort]") {
   }
 }
 
+TEST_CASE("Fixed Point Cells", "[sort]") {
+  uint32_t grid_width = std::floorf((X_BOUNDS.y() - X_BOUNDS.x()) / SUPPORT);
+  float cell_width = (X_BOUNDS.y() - X_BOUNDS.x()) / grid_width;
+  float fixed_step = (X_BOUNDS.y() - X_BOUNDS.x()) / (1u << FIXED_POINT_BITS);
+  Neighbours float_ns;
+  Neighbours fixed_ns;
+  fixed_ns.set_fixed_point_cells(true);
+
+  SECTION("Bounds map to the outermost cells") {
+    uint32_t bin_count = grid_width * grid_width * grid_width;
+    REQUIRE(fixed_ns.cell_index(Vec3{X_BOUNDS.x(), Y_BOUNDS.x(), Z_BOUNDS.x()}, grid_width) == 0);
+    REQUIRE(fixed_ns.cell_index(Vec3{X_BOUNDS.y(), Y_BOUNDS.y(), Z_BOUNDS.y()}, grid_width) == bin_count - 1);
+    REQUIRE(fixed_ns.cell_index(Vec3{-2.0f, 0.0f, 2.0f}, grid_width)
+            == fixed_ns.cell_index(Vec3{X_BOUNDS.x(), 0.0f, Z_BOUNDS.y()}, grid_width));
+  }
+
+  SECTION("Agrees with the float path away from cell faces") {
+    // Both paths round, so they may only disagree by one cell for positions
+    // a few float ulps from a face.
+    constexpr float FACE_TOLERANCE = 1e-6f;
+    // Cells this much wider than the support keep misplaced positions within
+    // the stencil's reach (see SimOpts::fixed_point_cells).
+    REQUIRE(cell_width - SUPPORT > FACE_TOLERANCE);
+    auto gen = random_Vec3(-1.0f, 1.0f);
+    uint32_t mismatches = 0;
+    float worst_error = 0;
+
+    for (int i = 0; i < 100000; i++) {
+      Vec3 pos = gen.get();
+      gen.next();
+
+      uint32_t fx, fy, fz, x, y, z;
+      fixed_ns.cell_indexes(pos, grid_width, fx, fy, fz);
+      float_ns.cell_indexes(pos, grid_width, x, y, z);
+      for (auto [fixed_cell, float_cell, coordinate] : { std::tuple{fx, x, pos.x()}, {fy, y, pos.y()}, {fz, z, pos.z()} }) {
+        float decoded = X_BOUNDS.x() + (Neighbours::fixed_point(coordinate) * fixed_step);
+        worst_error = std::max(worst_error, std::abs(decoded - coordinate));
+        if (fixed_cell == float_cell) {
+          continue;
+        }
+
+        mismatches++;
+        float face = X_BOUNDS.x() + (std::max(fixed_cell, float_cell) * cell_width);
+        INFO("Coordinate: " << coordinate << " Fixed: " << fixed_cell << " Float: " << float_cell);
+        REQUIRE((fixed_cell + 1 == float_cell || float_cell + 1 == fixed_cell));
+        REQUIRE(std::abs(coordinate - face) < FACE_TOLERANCE);
+      }
+    }
+
+    INFO("Mismatched axes: " << mismatches << " Worst quantization error: " << worst_error);
+    REQUIRE(worst_error < FACE_TOLERANCE);
+    REQUIRE(mismatches < 10);
+  }
+
+  SECTION("Sorts like the float path") {
+    SimOpts sim_opts{
+      .bench_mode = false,
+      .particle_count = 512,
+      .particle_radius = 0,
+      .gas_constant = 0,
+      .rest_density = 0,
+      .support = SUPPORT,
+      .viscosity_constant = 0,
+      .fixed_point_cells = true,
+    };
+    auto gen = random_Vec3(-1.0f, 1.0f);
+    Particles ps;
+    ps.resize(sim_opts.particle_count);
+    for (auto &pos : ps.pos) {
+      pos = gen.get();
+      gen.next();
+    }
+
+    fixed_ns.process(ps, sim_opts);
+    for (size_t i = 1; i < ps.size(); i++) {
+      REQUIRE(fixed_ns.cell_index(ps.pos[i - 1], grid_width) <= fixed_ns.cell_index(ps.pos[i], grid_width));
+    }
+  }
+}
+
 TEST_CASE("Count Sort", "[sort]") {
   uint32_t grid_width = std::floorf((RIGHT_BOUND - LEFT_BOUND) / SUPPORT);
   Neighbours ns;
@@ -87,7 +169,7 @@ TEST_CASE("Count Sort", "[sort]") {
     vec_gen.next();
   }
 
-  std::vector<Vec3> orig_pos = ps.pos;
+  ParticleArray<Vec3> orig_pos = ps.pos;
   ns.process(ps, sim_opts);
 
   REQUIRE_THAT(orig_pos, Catch::Matchers::UnorderedEquals(ps.pos));
@@ -128,7 +210,7 @@ TEST_CASE("Fetch Neighbours", "[sort]") {
 
     ns.process(ps, sim_opts);
     Particles neighbours;
-    ns.neighbours_near(ps, ps.pos[0], sim_opts, neighbours);
+    ns.neighbours_near(ps, ps.pos[0], neighbours);
 
     // Make sure to include self in neighbours to match old logic.
     REQUIRE_THAT(neighbours.pos, Catch::Matchers::UnorderedEquals(ps.pos));
@@ -149,10 +231,162 @@ TEST_CASE("Fetch Neighbours", "[sort]") {
 
     ns.process(ps, sim_opts);
     Particles neighbours;
-    ns.neighbours_near(ps, ps.pos[0], sim_opts, neighbours);
+    ns.neighbours_near(ps, ps.pos[0], neighbours);
 
     // Make sure to include self in neighbours to match old logic.
-    ps.pos.erase(ps.pos.end());
+    ps.pos.erase(ps.pos.end() - 1);
     REQUIRE_THAT(neighbours.pos, Catch::Matchers::UnorderedEquals(ps.pos));
   }
 }
+
+TEST_CASE("Wider Stencils", "[sort]") {
+  uint32_t cell_ratio = GENERATE(1u, 2u, 3u);
+  bool prune_stencil = GENERATE(false, true);
+  Neighbours ns;
+  SimOpts sim_opts{
+    .bench_mode = false,
+    .particle_count = 256,
+    .particle_radius = 0,
+    .gas_constant = 0,
+    .rest_density = 0,
+    .support = SUPPORT,
+    .viscosity_constant = 0,
+    .cell_ratio = cell_ratio,
+    .prune_stencil = prune_stencil,
+  };
+  auto vec_gen = random_Vec3(-1.0f, 1.0f);
+  Particles ps;
+  ps.resize(sim_opts.particle_count);
+
+  for (auto &pos : ps.pos) {
+    pos = vec_gen.get();
+    vec_gen.next();
+  }
+
+  ns.process(ps, sim_opts);
+
+  INFO("Cell Ratio: " << cell_ratio << " Pruned: " << prune_stencil);
+  Particles neighbours;
+  for (const auto &pos : ps.pos) {
+    ns.neighbours_near(ps, pos, neighbours);
+
+    // Every particle within the support must be found, whatever the stencil.
+    std::vector<Vec3> expected;
+    std::vector<Vec3> found;
+    for (const auto &other : ps.pos) {
+      if ((other - pos).length_squared() < SUPPORT * SUPPORT) {
+        expected.push_back(other);
+      }
+    }
+    for (const auto &other : neighbours.pos) {
+      if ((other - pos).length_squared() < SUPPORT * SUPPORT) {
+        found.push_back(other);
+      }
+    }
+
+    REQUIRE_THAT(found, Catch::Matchers::UnorderedEquals(expected));
+  }
+}
+
+TEST_CASE("Sleeping Cells", "[sort]") {
+  Neighbours ns;
+  SimOpts sim_opts{
+    .bench_mode = false,
+    .particle_count = 24,
+    .particle_radius = 0,
+    .gas_constant = 0,
+    .rest_density = 0,
+    .support = SUPPORT,
+    .viscosity_constant = 0,
+    .sleep_cells = true,
+  };
+  Particles ps;
+  ps.resize(sim_opts.particle_count);
+
+  // Three clusters of 8: a still one in a corner cell, a moving one in the
+  // cell beside it and a still one in the far corner cell.
+  for (int i = 0; i < ps.size(); i++) {
+    float offset = 0.01f * (i % 8);
+    Vec3 centre = (i < 8)  ? Vec3{-0.9f, -0.9f, -0.9f}
+                : (i < 16) ? Vec3{-0.5f, -0.9f, -0.9f}
+                :            Vec3{0.9f, 0.9f, 0.9f};
+    ps.pos[i] = centre + Vec3{offset, offset, offset};
+    ps.vel[i] = (i >= 8 && i < 16) ? Vec3{0.15f, 0, 0} : Vec3{0, 0, 0};
+    // At rest, the fluid's forces balance gravity.
+    ps.force[i] = external_force(ps.pos[i], sim_opts.fountain_force) * -1.0f;
+  }
+
+  uint32_t grid_width = Neighbours::grid_width_for(sim_opts);
+  uint32_t still_cell = ns.cell_index(Vec3{-0.9f, -0.9f, -0.9f}, grid_width);
+  uint32_t moving_cell = ns.cell_index(Vec3{-0.5f, -0.9f, -0.9f}, grid_width);
+  uint32_t far_cell = ns.cell_index(Vec3{0.9f, 0.9f, 0.9f}, grid_width);
+  REQUIRE(still_cell != moving_cell);
+
+  for (uint32_t step = 0; step <= SLEEP_STEPS; step++) {
+    ns.process(ps, sim_opts);
+    particles::integrate(ps, sim_opts);
+    ns.update_activity(ps, sim_opts.time_step);
+  }
+  ns.process(ps, sim_opts);
+
+  SECTION("Still Cells Sleep Unless Disturbed") {
+    REQUIRE(ns.cell_asleep(far_cell));
+    REQUIRE_FALSE(ns.cell_asleep(still_cell));
+    REQUIRE_FALSE(ns.cell_asleep(moving_cell));
+
+    // Only the two awake clusters are left in blocks.
+    size_t blocked = 0;
+    for (const CellBlock &block : ns.cell_blocks()) {
+      REQUIRE((block.last_cell <= far_cell || block.first_cell > far_cell));
+      blocked += block.last_particle - block.first_particle;
+    }
+    REQUIRE(blocked == 16);
+  }
+
+  SECTION("Moving In Wakes A Cell") {
+    ps.pos[0] = Vec3{0.85f, 0.85f, 0.85f};
+    ns.process(ps, sim_opts);
+    REQUIRE_FALSE(ns.cell_asleep(far_cell));
+  }
+
+  SECTION("Disabled Sleeping Keeps Cells Awake") {
+    sim_opts.sleep_cells = false;
+    ns.process(ps, sim_opts);
+    REQUIRE_FALSE(ns.cell_asleep(far_cell));
+  }
+}
+
+TEST_CASE("Particles Resting On The Floor Sleep", "[sort]") {
+  Neighbours ns;
+  SimOpts sim_opts{
+    .bench_mode = false,
+    .particle_count = 8,
+    .particle_radius = 0,
+    .gas_constant = 0,
+    .rest_density = 0,
+    .support = SUPPORT,
+    .viscosity_constant = 0,
+    .sleep_cells = true,
+  };
+  Particles ps;
+  ps.resize(sim_opts.particle_count);
+
+  // No fluid force holds them up: gravity pulls them into the floor every
+  // step and the boundary puts them back.
+  for (int i = 0; i < ps.size(); i++) {
+    float offset = 0.01f * i;
+    ps.pos[i] = Vec3{-0.9f + offset, LOWER_BOUND, -0.9f + offset};
+    ps.vel[i] = Vec3{0, 0, 0};
+    ps.force[i] = Vec3{0, 0, 0};
+  }
+  uint32_t cell = ns.cell_index(ps.pos[0], Neighbours::grid_width_for(sim_opts));
+
+  for (uint32_t step = 0; step < 2 * SLEEP_STEPS; step++) {
+    ns.process(ps, sim_opts);
+    particles::integrate(ps, sim_opts);
+    ns.update_activity(ps, sim_opts.time_step);
+  }
+  ns.process(ps, sim_opts);
+
+  REQUIRE(ns.cell_asleep(cell));
+}
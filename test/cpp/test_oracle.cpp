@@ -0,0 +1,219 @@
+#include "../generators.h"
+#include "../oracle.h"
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <cpp/backend.h>
+#include <cpp/neighbours.h>
+#include <cpp/particles.h>
+#include <cpp/procs.h>
+#include <cpp/sim_opts.h>
+#include <cpp/task_pool.h>
+#include <vector>
+
+constexpr uint32_t ORACLE_PARTICLE_COUNT = 2048;
+constexpr float DENSITY_TOLERANCE = 1e-4f; // relative
+constexpr float FORCE_TOLERANCE = 1e-3f;   // relative to the largest force
+
+static SimOpts oracle_opts(uint32_t cell_ratio, bool prune_stencil, exec::Backend backend) {
+  return SimOpts{
+    .bench_mode = false,
+    .particle_count = ORACLE_PARTICLE_COUNT,
+    .particle_radius = PARTICLE_RADIUS,
+    .gas_constant = GAS_CONSTANT,
+    .rest_density = REST_DENSITY,
+    .support = SUPPORT,
+    .viscosity_constant = VISCOSITY_CONSTANT,
+    .cell_ratio = cell_ratio,
+    .prune_stencil = prune_stencil,
+    .backend = backend,
+  };
+}
+
+// Random positions and velocities, with a few particles pinned to the
+// corners and faces of the domain where cell indexing is most fragile.
+static Particles random_particles(uint32_t count) {
+  auto pos_gen = random_Vec3(-1.0f, 1.0f);
+  auto vel_gen = random_Vec3(-1.0f, 1.0f);
+  Particles ps;
+  ps.resize(count);
+
+  for (size_t i = 0; i < count; i++) {
+    ps.pos[i] = pos_gen.get();
+    ps.vel[i] = vel_gen.get();
+    pos_gen.next();
+    vel_gen.next();
+  }
+
+  ps.pos[0] = Vec3{ LEFT_BOUND, LOWER_BOUND, BACKWARD_BOUND };
+  ps.pos[1] = Vec3{ RIGHT_BOUND, UPPER_BOUND, FORWARD_BOUND };
+  ps.pos[2] = Vec3{ RIGHT_BOUND, 0, LEFT_BOUND };
+  ps.pos[3] = Vec3{ 0, 0, 0 };
+  return ps;
+}
+
+static float largest_force(const ParticleArray<Vec3> &forces) {
+  float largest = 0;
+  for (const auto &force : forces) {
+    largest = std::max(largest, force.length());
+  }
+  return largest;
+}
+
+TEST_CASE("Neighbour Search Matches Oracle", "[oracle]") {
+  uint32_t cell_ratio = GENERATE(1u, 2u, 3u);
+  bool prune_stencil = GENERATE(false, true);
+  bool fixed_point_cells = GENERATE(false, true);
+  SimOpts sim_opts = oracle_opts(cell_ratio, prune_stencil, exec::Backend::Serial);
+  sim_opts.fixed_point_cells = fixed_point_cells;
+  Particles ps = random_particles(sim_opts.particle_count);
+  Neighbours ns;
+
+  ns.process(ps, sim_opts);
+
+  INFO("Cell Ratio: " << cell_ratio << " Pruned: " << prune_stencil << " Fixed Point: " << fixed_point_cells);
+  for (size_t i = 0; i < ps.size(); i++) {
+    // Cells may hold candidates beyond the support, but none within it may
+    // be missed or visited twice.
+    std::vector<uint32_t> found;
+    ns.for_each_neighbour_cell(ps.pos[i], [&](uint32_t start_idx, uint32_t end_idx) {
+      for (uint32_t j = start_idx; j < end_idx; j++) {
+        if ((ps.pos[j] - ps.pos[i]).length_squared() < SUPPORT * SUPPORT) {
+          found.push_back(j);
+        }
+      }
+    });
+    std::sort(found.begin(), found.end());
+
+    INFO("Particle: " << i);
+    REQUIRE(found == oracle::neighbours_of(ps, i, SUPPORT));
+  }
+}
+
+TEST_CASE("Force Passes Match Oracle", "[oracle]") {
+  uint32_t cell_ratio = GENERATE(1u, 3u);
+  bool prune_stencil = GENERATE(false, true);
+  auto backend = GENERATE(exec::Backend::Serial, exec::Backend::ThreadPool);
+  bool tiled_cells = GENERATE(false, true);
+  SimOpts sim_opts = oracle_opts(cell_ratio, prune_stencil, backend);
+  sim_opts.tiled_cells = tiled_cells;
+  Particles ps = random_particles(sim_opts.particle_count);
+  Neighbours ns;
+
+  task_pool().resize(4);
+  ns.process(ps, sim_opts);
+  Particles expected = ps;
+
+  INFO("Cell Ratio: " << cell_ratio << " Pruned: " << prune_stencil
+       << " Backend: " << exec::backend_name(backend) << " Tiled: " << tiled_cells);
+
+  particles::calculate_density_pressure(ps, ns, sim_opts);
+  oracle::density_pressure(expected, sim_opts);
+  for (size_t i = 0; i < ps.size(); i++) {
+    INFO("Particle: " << i << " Density: " << ps.density[i] << " Expected: " << expected.density[i]);
+    REQUIRE(std::abs(ps.density[i] - expected.density[i]) <= DENSITY_TOLERANCE * expected.density[i]);
+  }
+
+  // Feed both force passes the same densities, so each is checked on its own.
+  expected.density = ps.density;
+  expected.pressure = ps.pressure;
+
+  particles::calculate_pressure_forces(ps, ns, sim_opts);
+  ParticleArray<Vec3> expected_pforce = oracle::pressure_forces(expected);
+  float pforce_margin = FORCE_TOLERANCE * largest_force(expected_pforce);
+  for (size_t i = 0; i < ps.size(); i++) {
+    INFO("Particle: " << i);
+    REQUIRE((ps.force[i] - expected_pforce[i]).length() <= pforce_margin);
+  }
+
+  // The viscosity pass adds to the pressure forces, so check it from zero.
+  for (auto &force : ps.force) {
+    force = Vec3{0, 0, 0};
+  }
+  particles::calculate_viscosity_forces(ps, ns, sim_opts);
+  ParticleArray<Vec3> expected_vforce = oracle::viscosity_forces(expected, sim_opts);
+  task_pool().resize(1);
+
+  float vforce_margin = FORCE_TOLERANCE * largest_force(expected_vforce);
+  for (size_t i = 0; i < ps.size(); i++) {
+    INFO("Particle: " << i);
+    REQUIRE((ps.force[i] - expected_vforce[i]).length() <= vforce_margin);
+  }
+}
+
+TEST_CASE("Field Sampling Matches Oracle", "[oracle]") {
+  uint32_t cell_ratio = GENERATE(1u, 3u);
+  bool prune_stencil = GENERATE(false, true);
+  auto backend = GENERATE(exec::Backend::Serial, exec::Backend::ThreadPool);
+  SimOpts sim_opts = oracle_opts(cell_ratio, prune_stencil, backend);
+  Particles ps = random_particles(sim_opts.particle_count);
+  Neighbours ns;
+
+  task_pool().resize(4);
+  ns.process(ps, sim_opts);
+  particles::calculate_density_pressure(ps, ns, sim_opts);
+
+  // Uneven voxel counts over a volume reaching a little past the box.
+  const Vec3 low{ -1.1f, -1.1f, -1.1f };
+  const Vec3 high{ 1.1f, 1.1f, 1.1f };
+  constexpr uint32_t WIDTH = 20, HEIGHT = 16, DEPTH = 12;
+  std::vector<float> voxel_density(WIDTH * HEIGHT * DEPTH);
+  std::vector<Vec3> voxel_velocity(WIDTH * HEIGHT * DEPTH);
+  FieldVolume volume{
+    .low = low,
+    .high = high,
+    .width = WIDTH,
+    .height = HEIGHT,
+    .depth = DEPTH,
+    .density = voxel_density,
+    .velocity = voxel_velocity,
+  };
+  ns.sample_volume(ps, volume, backend);
+
+  // Probes at the voxel centres, in voxel order, then random ones.
+  std::vector<Vec3> probes;
+  const uint32_t dims[3] = { WIDTH, HEIGHT, DEPTH };
+  float spacing[3];
+  for (int axis = 0; axis < 3; axis++) {
+    spacing[axis] = (high.data[axis] - low.data[axis]) / dims[axis];
+  }
+  for (uint32_t z = 0; z < DEPTH; z++) {
+    for (uint32_t y = 0; y < HEIGHT; y++) {
+      for (uint32_t x = 0; x < WIDTH; x++) {
+        probes.push_back(Vec3{
+          low.x() + ((x + 0.5f) * spacing[0]),
+          low.y() + ((y + 0.5f) * spacing[1]),
+          low.z() + ((z + 0.5f) * spacing[2]),
+        });
+      }
+    }
+  }
+  auto probe_gen = random_Vec3(-1.2f, 1.2f);
+  for (int i = 0; i < 256; i++) {
+    probes.push_back(probe_gen.get());
+    probe_gen.next();
+  }
+
+  std::vector<float> density(probes.size());
+  std::vector<Vec3> velocity(probes.size());
+  ns.sample_fields(ps, probes, density, velocity, backend);
+  task_pool().resize(1);
+
+  ParticleArray<float> expected_density = oracle::sample_density(ps, probes);
+  ParticleArray<Vec3> expected_velocity = oracle::sample_velocity(ps, probes);
+  float density_margin = DENSITY_TOLERANCE * *std::max_element(expected_density.begin(), expected_density.end());
+  float velocity_margin = FORCE_TOLERANCE * largest_force(expected_velocity);
+
+  INFO("Cell Ratio: " << cell_ratio << " Pruned: " << prune_stencil
+       << " Backend: " << exec::backend_name(backend));
+  for (size_t p = 0; p < probes.size(); p++) {
+    INFO("Probe: " << p << " Density: " << density[p] << " Expected: " << expected_density[p]);
+    REQUIRE(std::abs(density[p] - expected_density[p]) <= density_margin);
+    REQUIRE((velocity[p] - expected_velocity[p]).length() <= velocity_margin);
+  }
+  for (size_t v = 0; v < voxel_density.size(); v++) {
+    INFO("Voxel: " << v << " Density: " << voxel_density[v] << " Expected: " << expected_density[v]);
+    REQUIRE(std::abs(voxel_density[v] - expected_density[v]) <= density_margin);
+    REQUIRE((voxel_velocity[v] - expected_velocity[v]).length() <= velocity_margin);
+  }
+}
@@ -0,0 +1,232 @@
+#include "../generators.h"
+#include "../misc_declarations.h"
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <cmath>
+#include <cpp/exec.h>
+#include <cpp/neighbours.h>
+#include <cpp/particles.h>
+#include <cpp/procs.h>
+#include <cpp/sim_opts.h>
+#include <vector>
+
+static SimOpts level_opts(uint32_t time_levels) {
+  return SimOpts{
+    .bench_mode = false,
+    .particle_count = 1024,
+    .particle_radius = PARTICLE_RADIUS,
+    .gas_constant = GAS_CONSTANT,
+    .rest_density = REST_DENSITY,
+    .support = SUPPORT,
+    .viscosity_constant = VISCOSITY_CONSTANT,
+    .time_levels = time_levels,
+  };
+}
+
+TEST_CASE("Time Step Levels", "[procs]") {
+  SimOpts sim_opts = level_opts(3);
+  Vec3 still{0, 0, 0};
+
+  REQUIRE(particles::time_level(still, still, sim_opts) == 0);
+
+  // Covers CFL_FACTOR of the support in between a half and a whole frame.
+  float speed = CFL_FACTOR * SUPPORT / (0.75f * TIME_STEP);
+  REQUIRE(particles::time_level(Vec3{speed, 0, 0}, still, sim_opts) == 1);
+  REQUIRE(particles::time_level(still, Vec3{0, 1e6f, 0}, sim_opts) == 2);
+
+  // Never finer than the levels there are.
+  REQUIRE(particles::time_level(Vec3{1e6f, 0, 0}, still, sim_opts) == 2);
+  REQUIRE(particles::time_level(Vec3{1e6f, 0, 0}, still, level_opts(1)) == 0);
+}
+
+TEST_CASE("Passes Only Update Due Particles", "[procs]") {
+  SimOpts sim_opts = level_opts(2);
+  sim_opts.backend = GENERATE(exec::Backend::Serial, exec::Backend::OpenMP, exec::Backend::StdPar, exec::Backend::ThreadPool);
+  auto pos_gen = random_Vec3(-1.0f, 1.0f);
+  Particles ps;
+  Neighbours ns;
+  ps.resize(sim_opts.particle_count);
+
+  for (size_t i = 0; i < ps.size(); i++) {
+    ps.pos[i] = pos_gen.get();
+    ps.vel[i] = Vec3{0, 0, 0};
+    ps.level[i] = i % 2;
+    pos_gen.next();
+  }
+  ns.process(ps, sim_opts);
+
+  Particles expected = ps;
+  particles::calculate_density_pressure(expected, ns, sim_opts);
+  particles::calculate_pressure_forces(expected, ns, sim_opts);
+
+  // Neighbours that are not due keep their densities from the full pass.
+  for (size_t i = 0; i < ps.size(); i++) {
+    ps.density[i] = (ps.level[i] == 0) ? expected.density[i] : -1.0f;
+    ps.pressure[i] = (ps.level[i] == 0) ? expected.pressure[i] : -1.0f;
+    ps.force[i] = Vec3{-1, -1, -1};
+  }
+  std::vector<uint32_t> due;
+  for (uint32_t i = 0; i < ps.size(); i++) {
+    if (ps.level[i] == 1) {
+      due.push_back(i);
+    }
+  }
+  particles::calculate_density_pressure(ps, ns, sim_opts, due);
+  particles::calculate_pressure_forces(ps, ns, sim_opts, due);
+
+  for (size_t i = 0; i < ps.size(); i++) {
+    INFO("Particle: " << i << " Level: " << int(ps.level[i]));
+    if (ps.level[i] == 1) {
+      REQUIRE(ps.density[i] == expected.density[i]);
+      REQUIRE(ps.force[i].x() == expected.force[i].x());
+      REQUIRE(ps.force[i].y() == expected.force[i].y());
+      REQUIRE(ps.force[i].z() == expected.force[i].z());
+    } else {
+      REQUIRE(ps.force[i].x() == -1.0f);
+    }
+  }
+}
+
+TEST_CASE("Multiple Time Stepping", "[procs]") {
+  SECTION("One Level Is A Single Step") {
+    SimOpts sim_opts = level_opts(1);
+    Particles expected;
+    Particles actual;
+    Neighbours ns;
+    expected.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+    actual.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+
+    for (int frame = 0; frame < 10; frame++) {
+      ns.process(expected, sim_opts);
+      particles::calculate_density_pressure(expected, ns, sim_opts);
+      particles::calculate_pressure_forces(expected, ns, sim_opts);
+      particles::calculate_viscosity_forces(expected, ns, sim_opts);
+      particles::integrate(expected, sim_opts);
+
+      particles::step(actual, ns, sim_opts);
+    }
+
+    for (size_t i = 0; i < actual.size(); i++) {
+      REQUIRE(actual.pos[i] == expected.pos[i]);
+    }
+  }
+
+  SECTION("Calm Particles Take Whole Steps") {
+    SimOpts sim_opts = level_opts(2);
+    sim_opts.particle_count = 64;
+    Particles expected;
+    Neighbours ns;
+    expected.resize(sim_opts.particle_count);
+
+    // Too far apart to interact, so only gravity acts on them.
+    for (size_t i = 0; i < expected.size(); i++) {
+      expected.pos[i] = Vec3{ -0.75f + 0.5f * (i % 4), -0.75f + 0.5f * ((i / 4) % 4), -0.75f + 0.5f * (i / 16) };
+      expected.vel[i] = Vec3{ 0, 0, 0 };
+      expected.level[i] = 0;
+    }
+    Particles actual = expected;
+
+    // Nothing is due on the second sub-step, which only moves particles.
+    particles::step(expected, ns, level_opts(1));
+    particles::step(actual, ns, sim_opts);
+
+    for (size_t i = 0; i < actual.size(); i++) {
+      INFO("Particle: " << i);
+      REQUIRE(actual.level[i] == 0);
+      REQUIRE((actual.pos[i] - expected.pos[i]).length() < 1e-5f);
+    }
+  }
+
+  SECTION("Fast Particles Take Finer Steps") {
+    SimOpts sim_opts = level_opts(3);
+    Particles ps;
+    Neighbours ns;
+    ps.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+    ps.vel[0] = Vec3{100, 0, 0};
+
+    particles::step(ps, ns, sim_opts);
+
+    uint32_t finest = 0;
+    for (size_t i = 0; i < ps.size(); i++) {
+      INFO("Particle: " << i);
+      REQUIRE(std::isfinite(ps.pos[i].x()));
+      REQUIRE(std::abs(ps.pos[i].x()) <= RIGHT_BOUND);
+      REQUIRE(ps.level[i] < sim_opts.time_levels);
+      finest += (ps.level[i] == sim_opts.time_levels - 1);
+    }
+    REQUIRE(finest > 0);
+  }
+}
+
+TEST_CASE("Density Kernel Gradient", "[procs]") {
+  constexpr float H = 1e-3f;
+  auto pos_gen = random_Vec3(-0.15f, 0.15f);
+
+  for (int sample = 0; sample < 64; sample++) {
+    Vec3 point{0, 0, 0};
+    Vec3 particle = pos_gen.get();
+    pos_gen.next();
+
+    // The gradient is taken with respect to `particle`, so it is the
+    // negated central difference in `point`.
+    Vec3 gradient = particles::kernel<particles::PolyGradKernel>(point, particle);
+    for (int axis = 0; axis < 3; axis++) {
+      Vec3 ahead = point;
+      Vec3 behind = point;
+      ahead.data[axis] += H;
+      behind.data[axis] -= H;
+      float difference = (particles::kernel<particles::PolyKernel>(ahead, particle)
+                        - particles::kernel<particles::PolyKernel>(behind, particle)) / (2 * H);
+
+      INFO("Particle: " << particle.x() << ", " << particle.y() << ", " << particle.z() << " Axis: " << axis);
+      REQUIRE(std::abs(gradient.data[axis] + difference) <= 0.02f * (std::abs(difference) + 1.0f));
+    }
+  }
+}
+
+TEST_CASE("PCISPH Holds Rest Density", "[procs]") {
+  SimOpts sim_opts = level_opts(1);
+  sim_opts.time_step = PCISPH_TIME_STEP;
+  sim_opts.pressure_solver = PressureSolver::Pcisph;
+  Particles ps;
+  Neighbours ns;
+  ps.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+
+  for (int step = 0; step < 60; step++) {
+    ns.process(ps, sim_opts);
+    particles::calculate_density_pressure(ps, ns, sim_opts);
+    uint32_t iterations = particles::calculate_pcisph_pressure(ps, ns, sim_opts);
+    particles::integrate(ps, sim_opts);
+
+    REQUIRE(iterations >= 1);
+    REQUIRE(iterations <= sim_opts.pcisph_max_iterations);
+  }
+
+  for (size_t i = 0; i < ps.size(); i++) {
+    INFO("Particle: " << i << " Density: " << ps.density[i]);
+    REQUIRE(std::isfinite(ps.vel[i].x()));
+    REQUIRE(ps.pressure[i] >= 0);
+    REQUIRE(ps.density[i] < 1.5f * REST_DENSITY);
+  }
+}
+
+TEST_CASE("PCISPH Stays Bounded In An Overfull Box", "[procs]") {
+  // The box holds about 2400 particles at rest density.
+  SimOpts sim_opts = level_opts(1);
+  sim_opts.particle_count = 3072;
+  sim_opts.time_step = 2 * TIME_STEP;
+  sim_opts.pressure_solver = PressureSolver::Pcisph;
+  Particles ps;
+  Neighbours ns;
+  ps.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+
+  for (int step = 0; step < 45; step++) {
+    particles::step(ps, ns, sim_opts);
+  }
+
+  for (size_t i = 0; i < ps.size(); i++) {
+    INFO("Particle: " << i << " Pressure: " << ps.pressure[i]);
+    REQUIRE(std::isfinite(ps.pressure[i]));
+    REQUIRE(ps.vel[i].length() < 100.0f);
+  }
+}
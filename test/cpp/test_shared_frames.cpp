@@ -0,0 +1,137 @@
+#include "../misc_declarations.h" // Includes functions required by Catch2 to work on custom types.
+#include <catch2/catch_test_macros.hpp>
+#include <cpp/shared_frames.h>
+#include <atomic>
+#include <cstdint>
+#include <fcntl.h>
+#include <format>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+TEST_CASE("Shared Frame Ring", "[shared_frames]") {
+  std::string name = std::format("/sph-test-frames-{}", getpid());
+  FramePublisher publisher(name, 256, 0.05f);
+  FrameSubscriber subscriber(name);
+
+  REQUIRE(subscriber.capacity() == 256);
+  REQUIRE(subscriber.particle_radius() == 0.05f);
+
+  SECTION("Reads nothing before the first frame") {
+    bool called = false;
+    REQUIRE(subscriber.read_latest(0, [&](std::span<const Vec3>, uint64_t) { called = true; }) == 0);
+    REQUIRE_FALSE(called);
+  }
+
+  SECTION("Reads the newest frame once") {
+    std::vector<Vec3> pos(200);
+    for (size_t i = 0; i < pos.size(); i++) {
+      pos[i] = Vec3{static_cast<float>(i), 1.0f, 2.0f};
+    }
+    publisher.publish(pos, 10);
+    pos[0] = Vec3{-1.0f, -1.0f, -1.0f};
+    publisher.publish(pos, 11);
+
+    std::vector<Vec3> read;
+    uint64_t step = 0;
+    uint64_t frame = subscriber.read_latest(0, [&](std::span<const Vec3> frame_pos, uint64_t frame_step) {
+      read.assign(frame_pos.begin(), frame_pos.end());
+      step = frame_step;
+    });
+    REQUIRE(frame == 2);
+    REQUIRE(step == 11);
+    REQUIRE(read == pos);
+
+    bool called = false;
+    REQUIRE(subscriber.read_latest(frame, [&](std::span<const Vec3>, uint64_t) { called = true; }) == frame);
+    REQUIRE_FALSE(called);
+  }
+
+  SECTION("Clamps frames to the capacity") {
+    std::vector<Vec3> pos(300, Vec3{0.5f, 0.5f, 0.5f});
+    publisher.publish(pos, 1);
+
+    size_t count = 0;
+    subscriber.read_latest(0, [&](std::span<const Vec3> frame_pos, uint64_t) { count = frame_pos.size(); });
+    REQUIRE(count == 256);
+  }
+
+  SECTION("Never accepts a torn frame") {
+    // Every particle of the frame of step s sits at (s, s, s), so a frame
+    // mixing two steps has particles that disagree.
+    constexpr uint64_t STEPS = 20000;
+    std::atomic<bool> done{false};
+    std::jthread writer([&]() {
+      std::vector<Vec3> pos(256);
+      for (uint64_t step = 1; step <= STEPS; step++) {
+        float value = static_cast<float>(step);
+        for (Vec3 &p : pos) {
+          p = Vec3{value, value, value};
+        }
+        publisher.publish(pos, step);
+      }
+      done.store(true);
+    });
+
+    uint64_t seen = 0;
+    uint64_t accepted = 0;
+    uint64_t torn = 0;
+    while (!done.load() || subscriber.latest() > seen) {
+      std::vector<Vec3> read;
+      uint64_t step = 0;
+      uint64_t frame = subscriber.read_latest(seen, [&](std::span<const Vec3> frame_pos, uint64_t frame_step) {
+        read.assign(frame_pos.begin(), frame_pos.end());
+        step = frame_step;
+      });
+      if (frame == seen) {
+        continue;
+      }
+
+      REQUIRE(frame > seen);
+      seen = frame;
+      accepted += 1;
+      float value = static_cast<float>(step);
+      for (const Vec3 &p : read) {
+        torn += (p.x() != value || p.y() != value || p.z() != value);
+      }
+    }
+
+    REQUIRE(accepted > 0);
+    REQUIRE(torn == 0);
+    REQUIRE(seen == STEPS);
+  }
+}
+
+TEST_CASE("Shared Frame Ring Attach Errors", "[shared_frames]") {
+  REQUIRE_THROWS_AS(FrameSubscriber(std::format("/sph-test-missing-{}", getpid())), std::runtime_error);
+
+  SECTION("Rejects an object that is not a frame ring") {
+    std::string name = std::format("/sph-test-garbage-{}", getpid());
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    REQUIRE(fd >= 0);
+    REQUIRE(ftruncate(fd, 4096) == 0);
+    close(fd);
+
+    REQUIRE_THROWS_AS(FrameSubscriber(name), std::runtime_error);
+    shm_unlink(name.c_str());
+  }
+}
+
+TEST_CASE("Shared Frame Ring Names", "[shared_frames]") {
+  std::string name = std::format("/sph-test-names-{}", getpid());
+  FramePublisher publisher(name, 64, 0.05f);
+
+  SECTION("Refuses an existing ring") {
+    REQUIRE_THROWS_AS(FramePublisher(name, 64, 0.05f), std::runtime_error);
+  }
+
+  SECTION("Replaces an existing ring when asked") {
+    FramePublisher replacement(name, 128, 0.05f, true);
+    FrameSubscriber subscriber(name);
+    REQUIRE(subscriber.capacity() == 128);
+  }
+}
@@ -0,0 +1,79 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cpp/neighbours.h>
+#include <cpp/particles.h>
+#include <cpp/procs.h>
+#include <cpp/sim_opts.h>
+#include <cpp/solver-c.h>
+#include <cstring>
+
+TEST_CASE("C API Steps Like The Solver", "[solver_c]") {
+  SphOptions opts;
+  sph_default_options(&opts);
+  opts.particle_count = 512;
+  opts.backend = SPH_BACKEND_SERIAL;
+
+  SphSolver *solver = nullptr;
+  REQUIRE(sph_create(&opts, &solver) == SPH_OK);
+  REQUIRE(solver != nullptr);
+
+  SECTION("Batched steps match single steps of the C++ solver") {
+    SimOpts sim_opts{
+      .bench_mode = false,
+      .particle_count = opts.particle_count,
+      .particle_radius = opts.particle_radius,
+      .gas_constant = opts.gas_constant,
+      .rest_density = opts.rest_density,
+      .support = opts.support,
+      .viscosity_constant = opts.viscosity_constant,
+      .backend = exec::Backend::Serial,
+    };
+    Particles expected;
+    Neighbours ns;
+    expected.reset(sim_opts.particle_count, X_BOUNDS.x(), X_BOUNDS.y());
+    for (uint32_t step = 0; step < 10; step++) {
+      particles::step(expected, ns, sim_opts);
+    }
+
+    REQUIRE(sph_step(solver, 4) == SPH_OK);
+    REQUIRE(sph_step(solver, 6) == SPH_OK);
+    REQUIRE(sph_step_count(solver) == 10);
+
+    uint32_t count = 0;
+    const float *pos = sph_positions(solver, &count);
+    REQUIRE(count == expected.size());
+    REQUIRE(std::memcmp(pos, expected.pos.data(), count * 3 * sizeof(float)) == 0);
+  }
+
+  SECTION("Positions are borrowed from the solver") {
+    uint32_t count = 0;
+    const float *before = sph_positions(solver, &count);
+    REQUIRE(sph_step(solver, 1) == SPH_OK);
+    REQUIRE(sph_positions(solver, nullptr) == before);
+  }
+
+  sph_destroy(solver);
+}
+
+TEST_CASE("C API Rejects Bad Options", "[solver_c]") {
+  SphOptions opts;
+  sph_default_options(&opts);
+  SphSolver *solver = nullptr;
+
+  SECTION("No particles") {
+    opts.particle_count = 0;
+  }
+  SECTION("Cell ratio out of range") {
+    opts.cell_ratio = MAX_CELL_RATIO + 1;
+  }
+  SECTION("Unknown backend") {
+    opts.backend = 99;
+  }
+  SECTION("Non-positive time step") {
+    opts.time_step = 0.0f;
+  }
+
+  REQUIRE(sph_create(&opts, &solver) == SPH_BAD_OPTIONS);
+  REQUIRE(solver == nullptr);
+  REQUIRE(sph_step(nullptr, 1) == SPH_BAD_OPTIONS);
+  REQUIRE(sph_positions(nullptr, nullptr) == nullptr);
+}
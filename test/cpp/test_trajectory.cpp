@@ -0,0 +1,146 @@
+#include "../generators.h"
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <cpp/particles.h>
+#include <cpp/recorder.h>
+#include <cpp/sim_opts.h>
+#include <cpp/trajectory.h>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// Half a quantization step over the box, plus float rounding.
+static const float POSITION_TOLERANCE = ((X_BOUNDS.y() - X_BOUNDS.x()) / 65535.0f) * 0.5f + 1e-6f;
+
+static bool close_to(Vec3 a, Vec3 b, float tolerance) {
+  return std::abs(a.x() - b.x()) <= tolerance
+      && std::abs(a.y() - b.y()) <= tolerance
+      && std::abs(a.z() - b.z()) <= tolerance;
+}
+
+TEST_CASE("Trajectory Frames Round Trip", "[trajectory]") {
+  constexpr uint32_t CAPACITY = 64;
+  uint32_t fields = TRAJ_VELOCITY | TRAJ_DENSITY;
+  TrajectoryHeader header{
+    .magic = {},
+    .version = TRAJECTORY_VERSION,
+    .capacity = CAPACITY,
+    .fields = fields,
+    .interval = 1,
+    .bounds_min = X_BOUNDS.x(),
+    .bounds_max = X_BOUNDS.y(),
+    .frame_size = trajectory::frame_size(CAPACITY, fields),
+    .frame_count = 0,
+  };
+  REQUIRE(header.frame_size % 8 == 0);
+
+  // Fewer particles than the capacity, one of them outside the bounds.
+  auto pos_gen = random_Vec3(-1.0f, 1.0f);
+  std::vector<Vec3> pos(CAPACITY - 5);
+  std::vector<Vec3> vel(pos.size(), Vec3{ 0.5f, -1.0f, 2.0f });
+  std::vector<float> density(pos.size(), REST_DENSITY);
+  for (auto &p : pos) {
+    p = pos_gen.get();
+    pos_gen.next();
+  }
+  pos[0] = Vec3{ 1.5f, -1.5f, 0.0f };
+
+  std::vector<std::byte> frame(header.frame_size);
+  trajectory::encode_frame(header, 42, pos, vel, density, frame.data());
+
+  FrameHeader frame_header;
+  std::memcpy(&frame_header, frame.data(), sizeof(FrameHeader));
+  REQUIRE(frame_header.step == 42);
+  REQUIRE(frame_header.particle_count == pos.size());
+
+  std::vector<Vec3> decoded(CAPACITY);
+  REQUIRE(trajectory::decode_positions(header, frame.data(), decoded) == pos.size());
+  REQUIRE(close_to(decoded[0], Vec3{ 1.0f, -1.0f, 0.0f }, POSITION_TOLERANCE));
+  for (size_t i = 1; i < pos.size(); i++) {
+    INFO("Particle: " << i);
+    REQUIRE(close_to(decoded[i], pos[i], POSITION_TOLERANCE));
+  }
+}
+
+TEST_CASE("Recorder Writes Every Interval", "[trajectory]") {
+  std::filesystem::path path = std::filesystem::temp_directory_path() / "sph-test-trajectory.bin";
+  constexpr uint32_t CAPACITY = 128;
+  Particles ps;
+  ps.reset(CAPACITY, X_BOUNDS.x(), X_BOUNDS.y());
+
+  {
+    Recorder recorder(path, CAPACITY, TRAJ_VELOCITY, 2);
+    for (uint64_t step = 0; step < 6; step++) {
+      recorder.record(ps, step);
+    }
+    // Three frames fit in the snapshot pool, so none are dropped.
+    REQUIRE(recorder.dropped_frames() == 0);
+  }
+  REQUIRE(!std::filesystem::is_empty(path));
+
+  std::ifstream file(path, std::ios::binary);
+  TrajectoryHeader header;
+  file.read(reinterpret_cast<char*>(&header), sizeof(TrajectoryHeader));
+  REQUIRE(std::memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) == 0);
+  REQUIRE(header.version == TRAJECTORY_VERSION);
+  REQUIRE(header.frame_count == 3);
+  REQUIRE(header.frame_size == trajectory::frame_size(CAPACITY, TRAJ_VELOCITY));
+  REQUIRE(std::filesystem::file_size(path) == sizeof(TrajectoryHeader) + (header.frame_count * header.frame_size));
+
+  std::vector<std::byte> frame(header.frame_size);
+  std::vector<Vec3> decoded(CAPACITY);
+  for (uint64_t f = 0; f < header.frame_count; f++) {
+    file.read(reinterpret_cast<char*>(frame.data()), frame.size());
+    FrameHeader frame_header;
+    std::memcpy(&frame_header, frame.data(), sizeof(FrameHeader));
+
+    INFO("Frame: " << f);
+    REQUIRE(frame_header.step == f * 2);
+    REQUIRE(trajectory::decode_positions(header, frame.data(), decoded) == CAPACITY);
+    for (size_t i = 0; i < CAPACITY; i++) {
+      REQUIRE(close_to(decoded[i], ps.pos[i], POSITION_TOLERANCE));
+    }
+  }
+
+  file.close();
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Playback Prefetches The Frames It Shows", "[trajectory]") {
+  std::array<uint64_t, 8> frames;
+
+  SECTION("Fractional rates repeat or skip frames") {
+    size_t count = trajectory::upcoming_frames(0.0, 1.5, 100, false, frames);
+    REQUIRE(std::vector(frames.begin(), frames.begin() + count) == std::vector<uint64_t>{ 0, 1, 3, 4, 6, 7, 9, 10 });
+
+    count = trajectory::upcoming_frames(0.0, 0.25, 100, false, frames);
+    REQUIRE(std::vector(frames.begin(), frames.begin() + count) == std::vector<uint64_t>{ 0, 0, 0, 0, 1, 1, 1, 1 });
+  }
+
+  SECTION("Playback stops on the last frame") {
+    size_t count = trajectory::upcoming_frames(3.0, 1.5, 5, false, frames);
+    REQUIRE(std::vector(frames.begin(), frames.begin() + count) == std::vector<uint64_t>{ 3, 4 });
+  }
+
+  SECTION("Looping wraps around") {
+    size_t count = trajectory::upcoming_frames(3.0, 1.5, 5, true, frames);
+    REQUIRE(std::vector(frames.begin(), frames.begin() + count) == std::vector<uint64_t>{ 3, 4, 1, 2, 4, 0, 2, 3 });
+  }
+
+  SECTION("Matches drawn frames") {
+    double rate = GENERATE(0.4, 1.7, 3.0);
+    bool loop = GENERATE(false, true);
+    double position = 2.0;
+    size_t count = trajectory::upcoming_frames(position, rate, 20, loop, frames);
+
+    INFO("Rate: " << rate << " Loop: " << loop);
+    for (size_t k = 0; k < count; k++) {
+      REQUIRE(frames[k] == static_cast<uint64_t>(position));
+      trajectory::advance_playback(position, rate, 20, loop);
+    }
+  }
+}
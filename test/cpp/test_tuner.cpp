@@ -0,0 +1,73 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cpp/sim_opts.h>
+#include <cpp/tuner.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+TEST_CASE("Tune Cache Round Trip", "[tuner]") {
+  std::filesystem::path path = std::filesystem::temp_directory_path() / "sph-test-tune-cache.txt";
+  std::filesystem::remove(path);
+  SimOpts opts{ .particle_count = 1024 };
+  SimOpts tuned = opts;
+  tuned.cell_ratio = 3;
+  tuned.prune_stencil = true;
+  tuned.thread_count = 4;
+  tuned.block_size = 32;
+
+  REQUIRE_FALSE(tuner::load_cached(path, opts).has_value());
+  tuner::store_cached(path, tuned);
+
+  SECTION("Restores the tuned fields") {
+    auto cached = tuner::load_cached(path, opts);
+    REQUIRE(cached.has_value());
+    REQUIRE(cached->cell_ratio == 3);
+    REQUIRE(cached->prune_stencil);
+    REQUIRE(cached->thread_count == 4);
+    REQUIRE(cached->block_size == 32);
+    REQUIRE(cached->particle_count == opts.particle_count);
+  }
+
+  SECTION("Misses other particle counts and reproducible runs") {
+    SimOpts other = opts;
+    other.particle_count = 2048;
+    REQUIRE_FALSE(tuner::load_cached(path, other).has_value());
+
+    other = opts;
+    other.reproducible = true;
+    REQUIRE_FALSE(tuner::load_cached(path, other).has_value());
+  }
+
+  SECTION("Later entries win") {
+    tuned.cell_ratio = 2;
+    tuner::store_cached(path, tuned);
+    auto cached = tuner::load_cached(path, opts);
+    REQUIRE(cached.has_value());
+    REQUIRE(cached->cell_ratio == 2);
+  }
+
+  SECTION("Skips entries with an invalid cell ratio") {
+    tuned.cell_ratio = MAX_CELL_RATIO + 1;
+    tuner::store_cached(path, tuned);
+    tuned.cell_ratio = 0;
+    tuner::store_cached(path, tuned);
+    auto cached = tuner::load_cached(path, opts);
+    REQUIRE(cached.has_value());
+    REQUIRE(cached->cell_ratio == 3);
+  }
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("CPU Model Names Are Never Blank", "[tuner]") {
+  REQUIRE_FALSE(tuner::cpu_model().empty());
+
+  std::istringstream named("processor\t: 0\nmodel name\t: Example CPU @ 3.00GHz \nflags\t\t: fpu\n");
+  REQUIRE(tuner::cpu_model(named) == "Example CPU @ 3.00GHz");
+
+  std::istringstream blank("processor\t: 0\nmodel name\t: \t\r\n");
+  REQUIRE(tuner::cpu_model(blank) == "unknown");
+
+  std::istringstream missing("processor\t: 0\nflags\t\t: fpu\n");
+  REQUIRE(tuner::cpu_model(missing) == "unknown");
+}
@@ -0,0 +1,99 @@
+#include "oracle.h"
+
+#include <cpp/procs.h>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace oracle {
+  std::vector<uint32_t> neighbours_of(const Particles &ps, size_t i, float support) {
+    std::vector<uint32_t> found;
+    for (size_t j = 0; j < ps.size(); j++) {
+      if ((ps.pos[j] - ps.pos[i]).length_squared() < support * support) {
+        found.push_back(j);
+      }
+    }
+    return found;
+  }
+
+  void density_pressure(Particles &ps, const SimOpts &opts) {
+    for (size_t i = 0; i < ps.size(); i++) {
+      double density = 0.0;
+      for (size_t j = 0; j < ps.size(); j++) {
+        density += particles::kernel<particles::PolyKernel>(ps.pos[i], ps.pos[j]);
+      }
+
+      ps.density[i] = density;
+      ps.pressure[i] = opts.gas_constant * (ps.density[i] - opts.rest_density);
+    }
+  }
+
+  ParticleArray<Vec3> pressure_forces(const Particles &ps) {
+    ParticleArray<Vec3> forces(ps.size());
+    for (size_t i = 0; i < ps.size(); i++) {
+      // The kernels take non-const references.
+      Vec3 point = ps.pos[i];
+      double force[3] = { 0, 0, 0 };
+      for (size_t j = 0; j < ps.size(); j++) {
+        Vec3 particle = ps.pos[j];
+        Vec3 gradient = particles::kernel<particles::SpikyGradKernel>(point, particle);
+        double factor = (ps.pressure[i] + ps.pressure[j]) / (2.0 * ps.density[j]);
+        for (int axis = 0; axis < 3; axis++) {
+          force[axis] += gradient.data[axis] * factor;
+        }
+      }
+      forces[i] = Vec3{ float(force[0]), float(force[1]), float(force[2]) };
+    }
+    return forces;
+  }
+
+  ParticleArray<Vec3> viscosity_forces(const Particles &ps, const SimOpts &opts) {
+    ParticleArray<Vec3> forces(ps.size());
+    for (size_t i = 0; i < ps.size(); i++) {
+      Vec3 point = ps.pos[i];
+      double force[3] = { 0, 0, 0 };
+      for (size_t j = 0; j < ps.size(); j++) {
+        Vec3 particle = ps.pos[j];
+        double laplacian = particles::kernel<particles::ViscLaplKernel>(point, particle);
+        double factor = opts.viscosity_constant * laplacian / ps.density[j];
+        for (int axis = 0; axis < 3; axis++) {
+          force[axis] += (ps.vel[j].data[axis] - ps.vel[i].data[axis]) * factor;
+        }
+      }
+      forces[i] = Vec3{ float(force[0]), float(force[1]), float(force[2]) };
+    }
+    return forces;
+  }
+
+  ParticleArray<float> sample_density(const Particles &ps, std::span<const Vec3> probes) {
+    ParticleArray<float> densities(probes.size());
+    for (size_t p = 0; p < probes.size(); p++) {
+      Vec3 point = probes[p];
+      double density = 0.0;
+      for (size_t j = 0; j < ps.size(); j++) {
+        Vec3 particle = ps.pos[j];
+        density += particles::kernel<particles::PolyKernel>(point, particle);
+      }
+      densities[p] = density;
+    }
+    return densities;
+  }
+
+  ParticleArray<Vec3> sample_velocity(const Particles &ps, std::span<const Vec3> probes) {
+    ParticleArray<Vec3> velocities(probes.size());
+    for (size_t p = 0; p < probes.size(); p++) {
+      Vec3 point = probes[p];
+      double velocity[3] = { 0, 0, 0 };
+      for (size_t j = 0; j < ps.size(); j++) {
+        Vec3 particle = ps.pos[j];
+        double factor = particles::kernel<particles::PolyKernel>(point, particle) / ps.density[j];
+        for (int axis = 0; axis < 3; axis++) {
+          velocity[axis] += ps.vel[j].data[axis] * factor;
+        }
+      }
+      velocities[p] = Vec3{ float(velocity[0]), float(velocity[1]), float(velocity[2]) };
+    }
+    return velocities;
+  }
+}
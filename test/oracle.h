@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cpp/particles.h>
+#include <cpp/sim_opts.h>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/**
+ * Brute-force reference versions of the neighbour search and force passes.
+ * Every particle is checked against every other (O(N^2)) and sums are kept
+ * in double precision, so differential tests can hold any engine variant to
+ * the same answer.
+ */
+namespace oracle {
+  /**
+   * Indexes of every particle within `support` of particle `i` (itself
+   * included), in increasing order.
+   */
+  std::vector<uint32_t> neighbours_of(const Particles &ps, size_t i, float support);
+
+  void density_pressure(Particles &ps, const SimOpts &opts);
+
+  // Each force on its own, where `Particles::force` holds their sum.
+  ParticleArray<Vec3> pressure_forces(const Particles &ps);
+  ParticleArray<Vec3> viscosity_forces(const Particles &ps, const SimOpts &opts);
+
+  // The interpolated fields of `Neighbours::sample_fields` at each probe.
+  ParticleArray<float> sample_density(const Particles &ps, std::span<const Vec3> probes);
+  ParticleArray<Vec3> sample_velocity(const Particles &ps, std::span<const Vec3> probes);
+}